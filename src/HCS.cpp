@@ -8,14 +8,13 @@
 
 #include "HCS.h"
 
-#include <sys/ioctl.h>
 #include <iostream>
 #include <exception>
 
 #include <cstdlib>
 
 #include <iomanip>
-#include <sstream>
+#include <fstream>
 
 #include <chrono>
 #include <thread>
@@ -24,29 +23,39 @@
 
 #include <cstring>
 #include <cerrno>
+#include <algorithm>
 
+#include "Log.h"
 #include "Serial.h"
+#include "HCSManager.h"
 
 #ifdef __MANSON_TEST
 #include <vector>
 #include <algorithm>
 #endif
 
-int HCS::fd = -1;
-bool HCS::initialized = false;
-
-const std::string HCS::UART_COMMAND_GMAX = "GMAX";
-const std::string HCS::UART_COMMAND_VOLT = "VOLT";
-const std::string HCS::UART_COMMAND_CURRENT = "CURR";
-const std::string HCS::UART_COMMAND_GETS = "GETS";
-const std::string HCS::UART_COMMAND_GETD = "GETD";
-const std::string HCS::UART_COMMAND_GOVP = "GOVP";
-const std::string HCS::UART_COMMAND_SOVP = "SOVP";
-const std::string HCS::UART_COMMAND_GOCP = "GOCP";
-const std::string HCS::UART_COMMAND_SOCP = "SOCP";
-const std::string HCS::UART_COMMAND_GETM = "GETM";
-const std::string HCS::UART_COMMAND_RUNM = "RUNM";
-const std::string HCS::UART_COMMAND_PROM = "PROM";
+// deadline of the commands of this thread, see HCS::Deadline
+static thread_local std::chrono::steady_clock::time_point callDeadline = std::chrono::steady_clock::time_point::max();
+// commands written with one writev()
+static constexpr int transmitMax = 32;
+
+static uint64_t toMicroseconds(const std::chrono::steady_clock::duration d)
+{
+	return std::max<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(d).count(), 0);
+}
+
+const std::string HCS::UART_COMMAND_GMAX = Protocol::spec(Protocol::Command::GMAX).mnemonic;
+const std::string HCS::UART_COMMAND_VOLT = Protocol::spec(Protocol::Command::VOLT).mnemonic;
+const std::string HCS::UART_COMMAND_CURRENT = Protocol::spec(Protocol::Command::CURR).mnemonic;
+const std::string HCS::UART_COMMAND_GETS = Protocol::spec(Protocol::Command::GETS).mnemonic;
+const std::string HCS::UART_COMMAND_GETD = Protocol::spec(Protocol::Command::GETD).mnemonic;
+const std::string HCS::UART_COMMAND_GOVP = Protocol::spec(Protocol::Command::GOVP).mnemonic;
+const std::string HCS::UART_COMMAND_SOVP = Protocol::spec(Protocol::Command::SOVP).mnemonic;
+const std::string HCS::UART_COMMAND_GOCP = Protocol::spec(Protocol::Command::GOCP).mnemonic;
+const std::string HCS::UART_COMMAND_SOCP = Protocol::spec(Protocol::Command::SOCP).mnemonic;
+const std::string HCS::UART_COMMAND_GETM = Protocol::spec(Protocol::Command::GETM).mnemonic;
+const std::string HCS::UART_COMMAND_RUNM = Protocol::spec(Protocol::Command::RUNM).mnemonic;
+const std::string HCS::UART_COMMAND_PROM = Protocol::spec(Protocol::Command::PROM).mnemonic;
 
 const std::string HCS::UART_RESPONSE_OK = "OK";
 
@@ -61,17 +70,91 @@ public:
 	ExprectedReceiveError(std::string msg):runtime_error(msg.c_str()){}
 };
 
+/**
+ * Reads the max values and upper limits, that are not cached, with a single write.
+ * The max values are taken from the capability cache file, if it is set.
+ */
 void HCS::init() {
 	try{
 		if(!connected){
 			throw std::runtime_error("failed to read max values. HSC is not connected via uart");
 		}
-		maxValues = this->getMaxValues();
-		getPresentUpperLimitVoltage();
-		getPresentUpperLimitCurrent();
-		initialized = true;
+
+		Batch b(*this);
+		const bool readMaxValues = !maxValuesCached && !loadCapabilityCache();
+		size_t gmax = 0;
+
+		if(readMaxValues){
+			gmax = b.getMaxValues();
+		}
+		if(!upperLimitsCached){
+			b.getPresentUpperLimitVoltage();
+			b.getPresentUpperLimitCurrent();
+		}
+		if(b.size() == 0){
+			return;
+		}
+
+		b.execute();
+		upperLimitsCached = true;
+		if(readMaxValues){
+			storeCapabilityCache(b.response(gmax));
+		}
 	}catch (std::runtime_error& e) {
-		std::cerr << e.what() << '\n';
+		MANSON_LOG_ERROR(e.what());
+	}
+}
+
+/**
+ * Drops the cached max values and upper limits, so they are read again by the next command,
+ * that needs them, and the shadowed setpoints, so the next write is sent.
+ * Call it, if the device was changed at its front panel.
+ */
+void HCS::invalidate()
+{
+	maxValuesCached = false;
+	upperLimitsCached = false;
+	for(int& v : shadow){
+		v = UNKNOWN;
+	}
+}
+
+/**
+ * Sets a file, that caches the max values (GMAX) of this device across connections.
+ * It is read instead of sending GMAX and written after GMAX was received.
+ */
+void HCS::setCapabilityCache(const std::string& path)
+{
+	capabilityCache = path;
+}
+
+bool HCS::loadCapabilityCache()
+{
+	if(capabilityCache.empty()){
+		return false;
+	}
+
+	std::ifstream f(capabilityCache);
+	std::string gmax;
+	Protocol::Values values;
+	if(!(f >> gmax) || gmax.length() != 6 || !Protocol::decodeValues(gmax, values)){
+		return false;
+	}
+
+	maxValues = toMaxValues(gmax);
+	maxValuesCached = true;
+	return true;
+}
+
+void HCS::storeCapabilityCache(const std::string& gmax)
+{
+	if(capabilityCache.empty()){
+		return;
+	}
+
+	std::ofstream f(capabilityCache, std::ios::trunc);
+	if(!(f << gmax << '\n')){
+		MANSON_LOG_WARN("could not write capability cache <" << capabilityCache << ">");
 	}
 }
 
@@ -85,15 +168,15 @@ bool HCS::isConnected(void) {
 	try{
 		if(!connected)
 		{
-			if(fd < 0){
+			if(!transport->isOpen()){
 				throw std::runtime_error("device connected state is not synced to file diskriptor");
 			}
 		}
-		if (fd < 0) {
-			throw std::runtime_error("file descriptor is not set");
+		if (!transport->isOpen()) {
+			throw std::runtime_error("transport <" + transport->name() + "> is not open");
 		}
 	}catch (std::runtime_error& e) {
-		std::cerr << e.what() << '\n';
+		MANSON_LOG_ERROR(e.what());
 	}
 #endif
 	return true;
@@ -108,106 +191,117 @@ void HCS::setConnected()
 void HCS::connect(){
 
 #ifdef __MANSON_SIMULATION
-	throw std::runtime_error("SIMULATION mode is not implemented completely. Do not use -D__MANSON_SIMULATION in this version.");
-	std::cerr << "To use the simulation mode, create a socat stream:\n\tsocat PTY,link=/tmp/virtual-tty,raw,echo=0 -\n";
-	std::cout << "-D__MANSON_SIMULATION is set\nusing /tmp/virtual-tty as device, not usb.\n\n";
-	this->uart = "/tmp/virtual-tty";
+	if(!simulator){
+		simulator.reset(new HCSSimulator());
+	}
+	MANSON_LOG_INFO("-D__MANSON_SIMULATION is set, using simulated device <" << simulator->device() << ">, not usb");
+	this->uart = simulator->device();
+	transport.reset(new PtyTransport(uart));
 #endif
 
-	fd = (Serial::connect(uart.data(), baud));
+	transport->open();
+	rx.clear();
+	stale = 0;
+	invalidate();
+	timeouts.reset();
 
-
-#ifdef __MANSON_DEBUG
-		std::cout << "serial buffer contains " << getNumberBytesInSendBuffer() << " after connect\n";
-#endif
+	MANSON_LOG_DEBUG("serial buffer contains " << getNumberBytesInSendBuffer() << " after connect");
 
 	setConnected();
-	std::cout << "connecting to device <" << this->uart << "> \nbaud <" << this->baud << ">\n";
+	MANSON_LOG_INFO("connecting to device <" << this->uart << "> baud <" << this->baud << ">");
 }
 
 int HCS::getNumberBytesInSendBuffer()
 {
-  int result ;
-
-  if (ioctl (fd, FIONREAD, &result) == -1)
-    return -1 ;
-
-  return result ;
+	return transport->available();
 }
 
 void HCS::disconnect(){
 	if(connected){
-#ifdef __MANSON_DEBUG
-		std::cout << "serial buffer contains " << getNumberBytesInSendBuffer() << " before disconnect\n";
-#endif
+		MANSON_LOG_DEBUG("serial buffer contains " << getNumberBytesInSendBuffer() << " before disconnect");
 		flush();
-		Serial::disconnect(fd);
-		std::cout << "device disconnected()\n";
+		transport->close();
+		transactions.clear();
+		invalidate();
+		MANSON_LOG_INFO("device <" << this->uart << "> disconnected");
 		setDisconnected();
 	}
 }
 
 
-std::string HCS::receiveViaUart(uint8_t byteCount) {
-	isConnected();
-
-	uint8_t byteCounter = 0x0;
-	char c;
-	int i=0;
-	std::string received = "";
-
-#ifdef __MANSON_DEBUG
-	std::cout << "exprected response length (" << std::to_string(byteCount) << ")\n";
-#endif
-
-
-	auto start = std::chrono::high_resolution_clock::now();
-	int receivedBytes = 0x00;
-	auto timeout = 2000;
-	// wait for data available in usart buffer
-	while((!receivedBytes) && (ioctl(fd, FIONREAD, &receivedBytes ) >= 0))
-	{
-		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+/**
+ * Takes the response of the oldest transaction out of the ring buffer: responseLength
+ * bytes of payload, followed by "OK", if expectOk is set in the spec of the command.
+ * readable signals, that the driver has data available. It is fetched with one read().
+ */
+SerialReader::Frame HCS::receiveViaUart(const bool readable) {
+	char payload[UINT8_MAX];
+	Transaction& t = transactions.front();
 
-		auto end = std::chrono::high_resolution_clock::now();
-		auto diff = end - start;
-		int ms = std::chrono::duration_cast<std::chrono::milliseconds>(diff).count();
-		if(ms >= timeout)
-		{
-			return "";
-		}
+	if(readable){
+		read();
 	}
-
-	while ((c = Serial::getChar(fd)) != -1 && byteCounter < byteCount) {
-//		if (c < 0x20)  { // || c > 0x7E) {
-//			continue;
-//		}
-//		y = 4;
-		++i;
-		++byteCounter;
-
-#ifdef __MANSON_DEBUG
-		std::cout << "received byte [" << std::to_string(byteCounter) << "] <"
-				<< c << ">\n";
-//		std::cout << c;
-#endif
-		received += c;
+	if(!skipStale()){
+		return SerialReader::Frame::INCOMPLETE;
+	}
+	if(t.firstByte == std::chrono::steady_clock::time_point() && rx.available() > 0){
+		t.firstByte = std::chrono::steady_clock::now();
 	}
 
-#ifdef __MANSON_DEBUG
-		std::cout << "response count is " << std::to_string(byteCount) << " byte\n";
-#endif
+	SerialReader::Frame frame = rx.takeFrame(t.cmd.spec().responseLength, t.cmd.spec().expectOk, payload);
+	if(frame == SerialReader::Frame::COMPLETE){
+		t.response.assign(payload, t.cmd.spec().responseLength);
+		MANSON_LOG_TRACE("received response <" << t.response << "> for <" << t.cmd.text() << ">");
+	}
+	return frame;
+}
 
-	if(byteCounter != byteCount){
-		std::cerr << "WARN: received " << std::to_string(byteCounter) << " bytes, but exprected " << std::to_string(byteCount) << std::endl;
+/**
+ * Fetches the bytes, that the driver has available, with one read().
+ * A non-blocking descriptor may have nothing to read after all (EAGAIN)
+ */
+void HCS::read()
+{
+	const ssize_t n = rx.fill(*transport);
+	if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+		return;
 	}
-	return received;
+	if(n < 0){
+		std::string msg = std::string(strerror(errno));
+		throw std::runtime_error("read failed for usart: " + msg);
+	}
+	counters.recordReceived(n);
 }
 
-bool HCS::receiveOk() {
-	std::string s = receiveViaUart(2);
+/**
+ * true, if the oldest transaction expects data: its response, or the stale responses
+ * and the rest of a broken one, that are skipped at OK boundaries before it is resent
+ */
+bool HCS::receiving() const
+{
+	if(transactions.empty()){
+		return false;
+	}
+	const Transaction& front = transactions.front();
+	return front.state == Transaction::State::WAITING || (front.state == Transaction::State::BACKOFF && (stale > 0 || rx.resyncing()));
+}
 
-	return (s == "OK") ? true : false;
+/**
+ * Drops the rest of a broken response and the stale responses. Each of them ends
+ * with "OK", they are not framed by their length, which may be wrong after an error.
+ * returns true, if all of them are received
+ */
+bool HCS::skipStale()
+{
+	if(rx.resyncing()){
+		counters.recordDiscarded(rx.skip());
+	}
+	while(!rx.resyncing() && stale > 0)
+	{
+		--stale;
+		counters.recordDiscarded(rx.resync());
+	}
+	return !rx.resyncing();
 }
 
 void HCS::verifyReceived(const std::string& receivedData, const std::string& errMsg)
@@ -217,69 +311,471 @@ void HCS::verifyReceived(const std::string& receivedData, const std::string& err
 	}
 }
 
-std::string HCS::sendCommand(const std::string& cmd, const uint8_t receiveBytesCount, const bool expectOk)
+/**
+ * Queues a command. It is written to the device with the next transmit().
+ */
+void HCS::submit(const Protocol::Frame& cmd, const std::chrono::steady_clock::time_point expires)
+{
+	Transaction t;
+	t.cmd = cmd;
+	t.expires = expires;
+	t.submitted = std::chrono::steady_clock::now();
+	transactions.push_back(std::move(t));
+}
+
+/**
+ * Starts a command on this connection without waiting for its response.
+ * The transaction is driven by service() until it is finished.
+ */
+void HCS::begin(const Protocol::Frame& cmd)
 {
 	isConnected();
-	std::string response = "";
+	submit(cmd);
+	try{
+		transmit();
+	}catch (...) {
+		abort();
+		throw;
+	}
+}
+
+/**
+ * Two commands in flight, whose responses can not be told apart: the same frame
+ * (e.g. GOVP and GOCP, or VOLT and CURR), but different commands. If the response
+ * of the first one is lost, the one of the second would be taken for it.
+ * The responses of identical commands are interchangeable.
+ */
+static bool ambiguous(const Protocol::Frame& first, const Protocol::Frame& second)
+{
+	return Protocol::responseFrameLength(first.command) == Protocol::responseFrameLength(second.command) && first.text() != second.text();
+}
+
+/**
+ * Writes all queued commands with a single writev(). Their responses are
+ * matched to the commands in the order they were sent. A command, whose response
+ * is ambiguous with the one of the command in flight before it, is held back
+ * with the commands after it, until that response is received (see service()).
+ * A short write is continued with the rest, when the driver accepts data again,
+ * until the deadline of the first command. The commands count as written, when
+ * all of their bytes are written.
+ */
+void HCS::transmit()
+{
+	const auto now = std::chrono::steady_clock::now();
+	struct iovec out[transmitMax];
+	Transaction *sent[transmitMax];
+	int count = 0;
+	bool inFlight = false;
+	bool queued = false;
+
+	if(transactions.empty() || (transactions.front().state == Transaction::State::BACKOFF && now < transactions.front().deadline)){
+		return;
+	}
 
-	constexpr unsigned int sendTryCounterMax = 0x05;
-	unsigned int sendTryCounter = 0x00;
-	bool resend = true;
+	for(const auto& t : transactions)
+	{
+		inFlight |= (t.state == Transaction::State::WAITING);
+		queued |= (t.state == Transaction::State::QUEUED || t.state == Transaction::State::BACKOFF);
+	}
+	if(!queued){
+		return;
+	}
 
-	while((resend) && ++sendTryCounter <= sendTryCounterMax)
+	// after a framing error, the input is dropped, when no response is expected anymore.
+	// Responses, that are still missing, are lost
+	if(!inFlight && (stale > 0 || rx.resyncing()))
 	{
-		resend = false;
-		// if there is no response, we try to send the command again
-		if(sendTryCounter > 1){
-			std::cout << "resending Command <" << cmd << ">\n";
+		counters.recordDiscarded(rx.available() + transport->discard());
+		rx.clear();
+		stale = 0;
+	}
+
+	auto write = [this, &out, &sent, &count]() {
+		struct iovec *rest = out;
+		int left = count;
+		while(left > 0)
+		{
+			const ssize_t n = transport->write(rest, left);
+			if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+			{
+				const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(sent[0]->deadline - std::chrono::steady_clock::now()).count();
+				if(remaining <= 0){
+					throw std::runtime_error("output buffer is full, command <" + std::string(sent[count - left]->cmd.text()) + "> was not sent");
+				}
+				Serial::waitWritable(transport->descriptor(), remaining);
+				continue;
+			}
+			if(n <= 0)
+			{
+				throw std::runtime_error("no bytes were send for command: <" + std::string(transactions.front().cmd.text()) + ">");
+			}
+			counters.recordWritten(n);
+
+			// skip the commands, that are written, and continue in the middle of a partly written one
+			size_t done = n;
+			while(left > 0 && done >= rest->iov_len)
+			{
+				done -= rest->iov_len;
+				++rest;
+				--left;
+			}
+			if(left > 0)
+			{
+				rest->iov_base = static_cast<char*>(rest->iov_base) + done;
+				rest->iov_len -= done;
+			}
 		}
 
-		if(send(cmd) == 0)
+		const auto written = std::chrono::steady_clock::now();
+		for(int i = 0; i < count; ++i)
 		{
-			throw std::runtime_error("no bytes were send for command: <" + cmd + ">");
+			if(sent[i]->written == std::chrono::steady_clock::time_point()){
+				counters.recordSent(sent[i]->cmd.command, toMicroseconds(written - sent[i]->submitted));
+			}
+			sent[i]->written = written;
 		}
+		count = 0;
+	};
 
-		if(receiveBytesCount > 0)
+	const Transaction *previous = nullptr;
+	for(auto& t : transactions)
+	{
+		if(t.state == Transaction::State::WAITING){
+			previous = &t;
+		}
+		if(t.state != Transaction::State::QUEUED && t.state != Transaction::State::BACKOFF){
+			continue;
+		}
+		if(previous && ambiguous(previous->cmd, t.cmd)){
+			break;
+		}
+		previous = &t;
+		// if there is no response, we try to send the command again
+		if(t.failures > 0){
+			MANSON_LOG_DEBUG("resending Command <" << t.cmd.text() << ">");
+		}
+		sent[count] = &t;
+		out[count++] = {t.cmd.data, t.cmd.length};
+		t.state = Transaction::State::WAITING;
+		t.deadline = std::min<std::chrono::steady_clock::time_point>(now + timeouts.timeout(t.cmd, t.failures), t.expires);
+
+		if(count == transmitMax){
+			write();
+		}
+	}
+
+	if(count > 0){
+		write();
+	}
+}
+
+/**
+ * The oldest command did not receive a valid response. It is resent after a short
+ * break, the commands sent after it are resent with it.
+ * After all tries of the timeout policy, or if its deadline expires, the command fails
+ * and all following commands are dropped.
+ *
+ * The input is not flushed blindly: the broken response is dropped up to its "OK" and
+ * the responses of the following commands, that are already written, are skipped, when
+ * they arrive. The commands are resent, once they are received or timed out. So a late
+ * response is not taken for the one of a resent command.
+ */
+void HCS::retry()
+{
+	const auto now = std::chrono::steady_clock::now();
+	Transaction& front = transactions.front();
+	auto quiet = now + timeouts.resendDelay();
+
+	// stale responses, that are still missing after the timeout, are lost
+	stale = 0;
+	if(rx.available() > 0){
+		counters.recordResync(rx.resync(Protocol::responseFrameLength(front.cmd.command)));
+	}
+	for(auto it = transactions.begin(); it != transactions.end(); ++it)
+	{
+		if(it != transactions.begin())
 		{
-			response = receiveViaUart(receiveBytesCount);
-			if(response.empty()){
-				std::this_thread::sleep_for(std::chrono::milliseconds(200));
-				// missing response, we need to resend cmd
-				// but before clear the current usart buffer
-				flush();
-				resend = true;
-				std::cout << "WARN: response is empty. Resending command <" << cmd << ">\n";
-				continue; // try again to send this command
+			if(it->state == Transaction::State::WAITING)
+			{
+				++stale;
+				quiet = std::max(quiet, it->deadline);
 			}
+			it->state = Transaction::State::QUEUED;
 		}
+		it->firstByte = std::chrono::steady_clock::time_point();
+	}
+	// they may be received already
+	if(skipStale()){
+		quiet = now + timeouts.resendDelay();
+	}
+
+	if(++front.failures >= timeouts.tries() || now + timeouts.resendDelay() >= front.expires)
+	{
+		counters.recordFailed(front.cmd.command);
+		front.state = Transaction::State::FAILED;
+		transactions.erase(transactions.begin() + 1, transactions.end());
+		return;
+	}
+	counters.recordRetry(front.cmd.command);
+
+	// missing response or acknowledge (OK), we need to resend cmd after a short break
+	MANSON_LOG_WARN("response is incomplete. Resending command <" << front.cmd.text() << ">");
+	front.state = Transaction::State::BACKOFF;
+	front.deadline = quiet;
+}
+
+/**
+ * Advances the oldest transaction. It is called, when data is available (readable)
+ * or the deadline of the transaction has expired.
+ * returns true, if the oldest transaction is finished
+ */
+bool HCS::service(const bool readable)
+{
+	const auto now = std::chrono::steady_clock::now();
+	Transaction& front = transactions.front();
 
-		if(expectOk && !resend)
+	switch(front.state)
+	{
+	case Transaction::State::QUEUED:
+		// held back by transmit(), the response before it is received
+		transmit();
+		break;
+	case Transaction::State::BACKOFF:
+	{
+		// the line is quiet, when the rest of the broken response and the stale responses are received
+		const bool resyncing = stale > 0 || rx.resyncing();
+		if(readable){
+			read();
+		}
+		if(resyncing && skipStale()){
+			front.deadline = now;
+		}
+		if(now >= front.deadline){
+			transmit();
+		}
+		break;
+	}
+	case Transaction::State::WAITING:
+		switch(receiveViaUart(readable))
+		{
+		case SerialReader::Frame::COMPLETE:
 		{
-			// wait to receive "OK" from device
-			if(!HCS::receiveOk()){
-				std::this_thread::sleep_for(std::chrono::milliseconds(200));
-				std::cout << "WARN: Acknowledged (OK) is missing. Resending command <" << cmd << ">\n";
-				flush();
-				resend = true;
-				continue; // try again to send this command
+			const auto done = std::chrono::steady_clock::now();
+			front.state = Transaction::State::DONE;
+			counters.recordCompleted(front.cmd.command, toMicroseconds(front.firstByte - front.written), toMicroseconds(done - front.submitted));
+
+			// the round trip of a resent command is ambiguous, it is not sampled (Karn)
+			if(front.failures == 0)
+			{
+				const bool followsResponse = answered > front.written;
+				timeouts.sample(front.cmd, std::chrono::microseconds(toMicroseconds(done - (followsResponse ? answered : front.written))), followsResponse);
 			}
+			answered = done;
+			break;
 		}
+		case SerialReader::Frame::MALFORMED:
+			counters.recordMalformed(front.cmd.command);
+			MANSON_LOG_WARN("received malformed response, exprected " << std::to_string(front.cmd.spec().responseLength) << " bytes" << (front.cmd.spec().expectOk ? " and OK" : ""));
+			retry();
+			break;
+		case SerialReader::Frame::INCOMPLETE:
+			if(now >= front.deadline){
+				counters.recordTimeout(front.cmd.command);
+				MANSON_LOG_WARN("received " << std::to_string(rx.available()) << " bytes, but exprected " << std::to_string(front.cmd.spec().responseLength));
+				retry();
+			}
+			break;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return front.state == Transaction::State::DONE || front.state == Transaction::State::FAILED;
+}
+
+/**
+ * Removes the oldest, finished transaction and returns its response
+ */
+std::string HCS::finish()
+{
+	Transaction t = std::move(transactions.front());
+	transactions.pop_front();
+	finishedWritten = t.written;
+
+	if(!transactions.empty())
+	{
+		// the next response follows the one just received
+		Transaction& next = transactions.front();
+		next.deadline = std::min<std::chrono::steady_clock::time_point>(std::chrono::steady_clock::now() + timeouts.timeout(next.cmd, next.failures, true), next.expires);
 	}
 
-	if(sendTryCounter > sendTryCounterMax)
+	if(t.state == Transaction::State::FAILED)
 	{
-		throw std::runtime_error("response from Manson device is missing. Send cmd <" + cmd + ">\n");
+		forget(t.cmd.command);
+		throw std::runtime_error("response from Manson device is missing. Send cmd <" + std::string(t.cmd.text()) + ">\n");
 	}
-	return response;
+	acknowledge(t.cmd, t.response);
+	return std::move(t.response);
 }
 
-int HCS::send(const std::string& msg)
+/**
+ * Drops all transactions. The commands may have reached the device or not
+ */
+void HCS::abort()
+{
+	for(const Transaction& t : transactions)
+	{
+		forget(t.cmd.command);
+		if(t.state == Transaction::State::WAITING){
+			++stale;
+		}
+	}
+	transactions.clear();
+}
+
+// index of the value in shadow, that command c writes, -1 if it writes none
+static int shadowIndex(const Protocol::Command c)
+{
+	switch(c)
+	{
+	case Protocol::Command::VOLT: return 0;
+	case Protocol::Command::CURR: return 1;
+	case Protocol::Command::SOVP: return 2;
+	case Protocol::Command::SOCP: return 3;
+	default: return -1;
+	}
+}
+
+// RUNM loads the voltage and current of a memory preset
+static bool writes(const Protocol::Command c, const int index)
 {
-	unsigned int sendCnt = 0x00;
-	sendCnt = Serial::puts(fd, msg.c_str());
-	Serial::puts(fd, "\r\n");
-	flush();
-	return sendCnt;
+	return shadowIndex(c) == index || (c == Protocol::Command::RUNM && index < 2);
+}
+
+/**
+ * returns true, if cmd would not change the device: it writes the value, that the device
+ * acknowledged or reported last, and no other write of that value is in progress.
+ */
+bool HCS::elide(const Protocol::Frame& cmd)
+{
+	const int i = shadowIndex(cmd.command);
+	int value;
+	if(i < 0 || shadow[i] == UNKNOWN || !Protocol::decodeDigits(cmd.text(), 4, 3, value) || value != shadow[i]){
+		return false;
+	}
+	for(const Transaction& t : transactions)
+	{
+		if(writes(t.cmd.command, i)){
+			return false;
+		}
+	}
+
+	counters.recordElided(cmd.command);
+	MANSON_LOG_DEBUG("device <" << uart << "> already has <" << cmd.text() << ">, it is not sent");
+	return true;
+}
+
+/**
+ * Updates shadow with a finished command. The responses of GETS, GOVP and GOCP re-sync
+ * the values, a RUNM makes voltage and current unknown until they are read or written.
+ */
+void HCS::acknowledge(const Protocol::Frame& cmd, const std::string& response)
+{
+	int v, c;
+	switch(cmd.command)
+	{
+	case Protocol::Command::VOLT:
+	case Protocol::Command::CURR:
+	case Protocol::Command::SOVP:
+	case Protocol::Command::SOCP:
+		shadow[shadowIndex(cmd.command)] = Protocol::decodeDigits(cmd.text(), 4, 3, v) ? v : UNKNOWN;
+		break;
+	case Protocol::Command::GETS:
+		if(Protocol::decodeDigits(response, 0, 3, v) && Protocol::decodeDigits(response, 3, 3, c)){
+			shadow[0] = v;
+			shadow[1] = c;
+		}
+		break;
+	case Protocol::Command::GOVP:
+	case Protocol::Command::GOCP:
+		if(Protocol::decodeDigits(response, 0, 3, v)){
+			shadow[(cmd.command == Protocol::Command::GOVP) ? 2 : 3] = v;
+		}
+		break;
+	default:
+		forget(cmd.command);
+		break;
+	}
+}
+
+// the values, that command c writes, are unknown
+void HCS::forget(const Protocol::Command c)
+{
+	for(int i = 0; i < SHADOWED; ++i)
+	{
+		if(writes(c, i)){
+			shadow[i] = UNKNOWN;
+		}
+	}
+}
+
+/**
+ * Blocks until the oldest transaction is finished and returns its response
+ */
+std::string HCS::awaitResponse()
+{
+	bool readable = false;
+	while(!service(readable))
+	{
+		const Transaction& front = transactions.front();
+		if(!receiving())
+		{
+			std::this_thread::sleep_until(front.deadline);
+			readable = false;
+			continue;
+		}
+
+		// sleep in poll() until the device sends data or the response timed out
+		auto remaining = std::chrono::ceil<std::chrono::milliseconds>(front.deadline - std::chrono::steady_clock::now()).count();
+		readable = Serial::waitReadable(transport->descriptor(), std::max<int>(remaining, 0));
+	}
+
+	return finish();
+}
+
+HCS::Deadline::Deadline(const std::chrono::steady_clock::time_point t) : previous(callDeadline)
+{
+	callDeadline = std::min(callDeadline, t);
+}
+
+HCS::Deadline::~Deadline()
+{
+	callDeadline = previous;
+}
+
+std::chrono::steady_clock::time_point HCS::Deadline::current()
+{
+	return callDeadline;
+}
+
+std::string HCS::sendCommand(const Protocol::Frame& cmd, const bool force)
+{
+	if(manager && manager->isRunning())
+	{
+		if(std::this_thread::get_id() == manager->ioThread.get_id()){
+			throw std::runtime_error("can not send <" + std::string(cmd.text()) + "> to <" + uart + ">. A blocking call on the I/O thread would wait for itself, use HCSManager::post()");
+		}
+		// the connection is owned by the I/O thread, which elides the command
+		return std::move(manager->post({{this, cmd, "", force}}).front()).get();
+	}
+
+	std::lock_guard<std::mutex> lock(connectionMutex);
+	if(!force && elide(cmd)){
+		return "";
+	}
+	begin(cmd);
+	return awaitResponse();
 }
 
 /**
@@ -288,96 +784,120 @@ int HCS::send(const std::string& msg)
  */
 void HCS::flush(void)
 {
-	Serial::flush(&fd);
+	transport->drain();
+	counters.recordFlush(rx.available() + transport->discard());
+	rx.clear();
+	stale = 0;
 }
 
 void HCS::uartDebug(const std::string& data)
 {
-	std::cout << "sending via uart: " << data << "\n";
+	MANSON_LOG_DEBUG("sending via uart: " << data);
 }
 
-HCS::MansonData HCS::toMansonData(std::string& voltageCurrentString) {
-	float voltage = std::atoi(voltageCurrentString.substr(0, 3).c_str());
-	float current = std::atoi(voltageCurrentString.substr(3, 3).c_str());
-
-	voltage = voltage / 10.0f;
-	current = current / 10.0f;
-
-	return std::move(std::make_pair(voltage, current));
+/**
+ * returns the CURR command for current, after it is validated against max and limit values
+ */
+Protocol::Frame HCS::currentCommand(const float current) {
+	if(current < 0.0f || current >= static_cast<int>(getMaxCurrent()))
+	{
+		throw std::runtime_error("current has to be between 0 and 32,5V");
+	}
+	else if(current > upperLimits.second){
+		throw LimitExceededError("current is limited by upper current limit to <" + std::to_string(upperLimits.second) + "> A");
+	}
+	int curr = current * 10;
+	return Protocol::encode<Protocol::Command::CURR>(curr);
 }
 
-void HCS::setCurrent(const float current) {
+void HCS::setCurrent(const float current, const bool force) {
 	try{
 		isConnected();
 
-		if(current < 0.0f || current >= static_cast<int>(getMaxCurrent()))
-		{
-			throw std::runtime_error("current has to be between 0 and 32,5V");
-		}
-		else if(current > upperLimits.second){
-			throw LimitExceededError("current is limited by upper current limit to <" + std::to_string(upperLimits.second) + "> A");
-		}
-		int curr = current * 10;
-		std::stringstream ss;
-
-		ss << std::setfill('0') << std::setw(3) << curr;
+		Protocol::Frame msg = currentCommand(current);
 
-		std::cout << std::fixed << std::setprecision(1) << "setting current to: <" << current << "A>\n";
+		MANSON_LOG_INFO(std::fixed << std::setprecision(1) << "setting current to: <" << current << "A>");
 
-		std::string msg = UART_COMMAND_CURRENT + ss.str();
-		sendCommand(msg, 0, true);
+		sendCommand(msg, force);
 	}catch (LimitExceededError& e) {
-				std::cerr << "could not set current to <" << current << ">: " << e.what() << std::endl;
+				MANSON_LOG_ERROR("could not set current to <" << current << ">: " << e.what());
 	}
 }
 
-void HCS::setVoltage(const float voltage)
+/**
+ * returns the VOLT command for voltage, after it is validated against max and limit values
+ */
+Protocol::Frame HCS::voltageCommand(const float voltage)
+{
+	if(voltage < 0.0f || voltage > static_cast<int>(getMaxVoltage()))
+	{
+		throw std::runtime_error("voltage has to be between 0 and " + std::to_string(getMaxVoltage()));
+	}else if(voltage > upperLimits.first){
+		throw LimitExceededError("voltage is limited by upper voltage limit to <" + std::to_string(upperLimits.first) + "> V");
+	}
+
+	int volt = voltage * 10;
+	return Protocol::encode<Protocol::Command::VOLT>(volt);
+}
+
+void HCS::setVoltage(const float voltage, const bool force)
 {
 	try{
 		isConnected();
 
-		if(voltage < 0.0f || voltage > static_cast<int>(getMaxVoltage()))
-		{
-			throw std::runtime_error("voltage has to be between 0 and " + std::to_string(getMaxVoltage()));
-		}else if(voltage > upperLimits.first){
-			throw LimitExceededError("voltage is limited by upper voltage limit to <" + std::to_string(upperLimits.first) + "> V");
-		}
+		Protocol::Frame msg = voltageCommand(voltage);
 
-		int volt = voltage * 10;
-		std::stringstream ss;
+		MANSON_LOG_INFO(std::fixed << std::setprecision(1) << "setting voltage to: <" << voltage << "V>");
 
-		std::cout << std::fixed << std::setprecision(1) << "setting voltage to: <" << voltage << "V>\n";
-		ss << std::setfill('0') << std::setw(3) << volt;
-
-		std::string msg = UART_COMMAND_VOLT + ss.str();
-		sendCommand(msg, 0, true);
+		sendCommand(msg, force);
 	}catch (LimitExceededError& e) {
-		std::cerr << "could not set voltage  to <" << voltage << ">: " << e.what() << std::endl;
+		MANSON_LOG_ERROR("could not set voltage  to <" << voltage << ">: " << e.what());
 	}
 }
 
-std::string HCS::readStatus() {
-
-	std::string status = sendCommand(UART_COMMAND_GETD, 9, true);
-	std::string s = status.substr(0, 5);
-//	displayValue = toMansonData(s);		// FIXME: the returned value is 4 byte, not 3. so the conversion toMansionData won't work here
+/**
+ * Decodes the response of GETD and keeps it as display value
+ */
+Protocol::Measurement HCS::toDisplay(const std::string& status) {
+	Protocol::Measurement m;
+	if(!Protocol::decodeDisplay(status, m)){
+		throw ExprectedReceiveError("malformed display values <" + status + "> received via uart");
+	}
 
-	statusCC = std::atoi(status.substr(8,1).c_str());
+	displayValue = std::make_pair(m.voltage, m.current);
+	statusCC = (m.mode == Protocol::Mode::CC);
+	statusCV = (m.mode == Protocol::Mode::CV);
+	return m;
+}
 
-	if(statusCC){
+std::string HCS::toStatus(const std::string& status) {
+	if(toDisplay(status).mode == Protocol::Mode::CC){
 		return "CC activated";
 	}
 	return "CV activated";
 }
 
+std::string HCS::readStatus() {
+
+	std::string status = sendCommand(Protocol::encode<Protocol::Command::GETD>());
+	return toStatus(status);
+}
+
+Protocol::Measurement HCS::readDisplay() {
+	return toDisplay(sendCommand(Protocol::encode<Protocol::Command::GETD>()));
+}
+
 std::string HCS::getPresentVoltageAndCurrent(bool printOutput) {
-	std::string voltCurr = sendCommand(UART_COMMAND_GETS, 6, true);
+	std::string voltCurr = sendCommand(Protocol::encode<Protocol::Command::GETS>());
 
 	verifyReceived(voltCurr, "no present voltage and current received via uart");
-	MansonData d = toMansonData(voltCurr);
 
 	if(printOutput){
-		std::cout << "received present voltage: <" << std::fixed  << std::setprecision( 2 )  << d.first << "> " << "current: <" << d.second << ">\n";
+		Protocol::Measurement m;
+		if(!Protocol::decodeSetpoint(voltCurr, m)){
+			throw ExprectedReceiveError("malformed voltage and current <" + voltCurr + "> received via uart");
+		}
+		MANSON_LOG_INFO("received present voltage: <" << std::fixed  << std::setprecision( 2 )  << m.voltage << "> " << "current: <" << m.current << ">");
 	}
 
 	return voltCurr;
@@ -385,18 +905,18 @@ std::string HCS::getPresentVoltageAndCurrent(bool printOutput) {
 
 float HCS::getPresentUpperLimitVoltage(void){
 
-	std::string presentUpperLimit = sendCommand(UART_COMMAND_GOVP, 3, true);
+	std::string presentUpperLimit = sendCommand(Protocol::encode<Protocol::Command::GOVP>());
 	verifyReceived(presentUpperLimit, "no present upper voltage limit received via uart");
 
-	upperLimits = toMansonData(presentUpperLimit);
+	if(!Protocol::decodeLimit(presentUpperLimit, upperLimits.first)){
+		throw ExprectedReceiveError("malformed upper voltage limit <" + presentUpperLimit + "> received via uart");
+	}
 
-#ifdef __MANSON_DEBUG
-	std::cout << "received upper limit voltage: <" << upperLimits.first << ">\n";
-#endif
-	return upperLimits.second;
+	MANSON_LOG_DEBUG("received upper limit voltage: <" << upperLimits.first << ">");
+	return upperLimits.first;
 }
 
-void HCS::setUpperVoltageLimit(const float voltage)
+void HCS::setUpperVoltageLimit(const float voltage, const bool force)
 {
 	isConnected();
 
@@ -406,33 +926,28 @@ void HCS::setUpperVoltageLimit(const float voltage)
 						+ std::to_string(getMaxVoltage()));
 	}
 	int volt = voltage * 10;
-	std::stringstream ss;
 
-	std::cout << std::fixed << std::setprecision(1) << "setting setUpperVoltageLimit to: <" << voltage << "V>\n";
+	MANSON_LOG_INFO(std::fixed << std::setprecision(1) << "setting setUpperVoltageLimit to: <" << voltage << "V>");
 
-	ss << std::setfill('0') << std::setw(3) << volt;
+	sendCommand(Protocol::encode<Protocol::Command::SOVP>(volt), force);
 
-	std::string msg = UART_COMMAND_SOVP + ss.str();
-	sendCommand(msg, 0, true);
-
-	// update present upper limit
-	getPresentUpperLimitVoltage();
+	// the device accepted the limit, GOVP is not needed to update the cache
+	upperLimits.first = volt / 10.0f;
 }
 
 float HCS::getPresentUpperLimitCurrent(void){
-	std::string presentUpperLimit = sendCommand(UART_COMMAND_GOCP, 3, true);
+	std::string presentUpperLimit = sendCommand(Protocol::encode<Protocol::Command::GOCP>());
 	verifyReceived(presentUpperLimit, "no present upper current limit received via uart");
 
-	MansonData d = toMansonData(presentUpperLimit);
-	upperLimits.second = d.first;
-#ifdef __MANSON_DEBUG
-	std::cout << "received upper limit current: <" << upperLimits.second << ">\n";
-#endif
+	if(!Protocol::decodeLimit(presentUpperLimit, upperLimits.second)){
+		throw ExprectedReceiveError("malformed upper current limit <" + presentUpperLimit + "> received via uart");
+	}
+	MANSON_LOG_DEBUG("received upper limit current: <" << upperLimits.second << ">");
 
 	return upperLimits.second;
 }
 
-void HCS::setUpperCurrentLimit(const float current)
+void HCS::setUpperCurrentLimit(const float current, const bool force)
 {
 	isConnected();
 
@@ -442,46 +957,40 @@ void HCS::setUpperCurrentLimit(const float current)
 						+ std::to_string(getMaxCurrent()));
 	}
 	int curr = current * 10;
-	std::stringstream ss;
 
-	std::cout << std::fixed << std::setprecision(1) << "setting setUpperCurrentLimit to: <" << current << "V>\n";
+	MANSON_LOG_INFO(std::fixed << std::setprecision(1) << "setting setUpperCurrentLimit to: <" << current << "A>");
 
-	ss << std::setfill('0') << std::setw(3) << curr;
+	sendCommand(Protocol::encode<Protocol::Command::SOCP>(curr), force);
 
-	std::string msg = UART_COMMAND_SOCP + ss.str();
-	sendCommand(msg, 0, true);
-
-	// update present upper limit
-	getPresentUpperLimitCurrent();
+	// the device accepted the limit, GOCP is not needed to update the cache
+	upperLimits.second = curr / 10.0f;
 }
 
 
-void HCS::readMemoryValues()
+Protocol::Presets HCS::readMemoryValues()
 {
 	isConnected();
-	std::string voltCurr = sendCommand(UART_COMMAND_GETM, 18, true);
-	std::string s = "";
+	std::string voltCurr = sendCommand(Protocol::encode<Protocol::Command::GETM>());	// 3 x VVVCCC, separated by \r
+	Protocol::Presets presets;
 
 	verifyReceived(voltCurr, "no memory voltage and current values received via uart");
+	if(!Protocol::decodePresets(voltCurr, presets)){
+		throw ExprectedReceiveError("malformed memory values <" + voltCurr + "> received via uart");
+	}
 
-	s = voltCurr.substr(0, 5);
-	memory1 = toMansonData(s);
-
-	s = voltCurr.substr(6, 12);
-	memory2 = toMansonData(s);
-
-	s = voltCurr.substr(12, 17);
-	memory3 = toMansonData(s);
+	memory1 = std::make_pair(presets.memory[0].voltage, presets.memory[0].current);
+	memory2 = std::make_pair(presets.memory[1].voltage, presets.memory[1].current);
+	memory3 = std::make_pair(presets.memory[2].voltage, presets.memory[2].current);
 
-	std::cout << "Memory Voltage: \n";
-	std::cout << "M1: voltage: <" << std::fixed  << std::setprecision( 2 )  << memory1.first << ">  current: <" << memory1.second << ">\n";
-	std::cout << "M2: voltage: <" << std::fixed  << std::setprecision( 2 )  << memory2.first << ">  current: <" << memory2.second << ">\n";
-	std::cout << "M3: voltage: <" << std::fixed  << std::setprecision( 2 )  << memory3.first << ">  current: <" << memory3.second << ">\n";
+	MANSON_LOG_INFO("M1: voltage: <" << std::fixed  << std::setprecision( 2 )  << memory1.first << ">  current: <" << memory1.second << ">");
+	MANSON_LOG_INFO("M2: voltage: <" << std::fixed  << std::setprecision( 2 )  << memory2.first << ">  current: <" << memory2.second << ">");
+	MANSON_LOG_INFO("M3: voltage: <" << std::fixed  << std::setprecision( 2 )  << memory3.first << ">  current: <" << memory3.second << ">");
 
 	// GETM
 	// 050165138165250165
 	// 050010138165250165
 	// 111111022122033133
+	return presets;
 }
 
 void HCS::runMemory(MEMORY m)
@@ -490,12 +999,11 @@ void HCS::runMemory(MEMORY m)
 		throw std::runtime_error("bad memory position selected: " + static_cast<int>(m));
 	}
 
-	std::cout << "run voltage and current from memory <" << m << ">\n";
+	MANSON_LOG_INFO("run voltage and current from memory <" << m << ">");
 
 	isConnected();
 
-	std::string msg = UART_COMMAND_RUNM + std::to_string(m);
-	sendCommand(msg, 0, true);
+	sendCommand(Protocol::encode<Protocol::Command::RUNM>(m));
 }
 
 //void HCS::setMemory(MansonData& m0, MansonData& m1, MansonData& m2)
@@ -543,44 +1051,37 @@ void HCS::setMemory(float v0, float c0, float v1, float c1, float v2, float c2)
 	}
 
 
-	std::cout << "saving m0 <" << v0 << ", " << c0 << ">\n";
-	std::cout << "saving m1 <" << v1 << ", " << c1 << ">\n";
-	std::cout << "saving m2 <" << v2 << ", " << c2 << ">\n";
-
-	std::stringstream ss;
-	int v = 0x0;
-	int c = 0x0;
-
-	v =	v0 * 10;
-	c = c0 * 10;
-	ss << std::setfill('0') << std::setw(3) << v;
-	ss << std::setfill('0') << std::setw(3) << c;
-
-	v =	v1 * 10;
-	c = c1 * 10;
-	ss << std::setfill('0') << std::setw(3) << v;
-	ss << std::setfill('0') << std::setw(3) << c;
-
-	v =	v2 * 10;
-	c = c2 * 10;
-	ss << std::setfill('0') << std::setw(3) << v;
-	ss << std::setfill('0') << std::setw(3) << c;
+	MANSON_LOG_INFO("saving m0 <" << v0 << ", " << c0 << ">");
+	MANSON_LOG_INFO("saving m1 <" << v1 << ", " << c1 << ">");
+	MANSON_LOG_INFO("saving m2 <" << v2 << ", " << c2 << ">");
 
-	std::string msg = UART_COMMAND_PROM + ss.str();
+	// the values are truncated to 100mV/100mA, like by VOLT and CURR
+	Protocol::Frame msg = Protocol::encode<Protocol::Command::PROM>(
+			static_cast<int>(v0 * 10), static_cast<int>(c0 * 10),
+			static_cast<int>(v1 * 10), static_cast<int>(c1 * 10),
+			static_cast<int>(v2 * 10), static_cast<int>(c2 * 10));
 
-	std::cout << "MEMORY CMD: "<< msg << std::endl;
+	MANSON_LOG_DEBUG("MEMORY CMD: "<< msg.text());
 
-	std::string mv = sendCommand(msg, 0, true);
+	sendCommand(msg);
 
 }
 
 HCS::MansonData HCS::getMaxValues() {
 
 	isConnected();
-	std::string mv = sendCommand(UART_COMMAND_GMAX, 6, true);
+	std::string mv = sendCommand(Protocol::encode<Protocol::Command::GMAX>());
 	verifyReceived(mv, "no max values received via uart");
 
-	MansonData d = toMansonData(mv);
+	return toMaxValues(mv);
+}
+
+HCS::MansonData HCS::toMaxValues(const std::string& gmax) {
+	Protocol::Values values;
+	if(!Protocol::decodeValues(gmax, values)){
+		throw ExprectedReceiveError("malformed max values <" + gmax + "> received via uart");
+	}
+	MansonData d(values.voltage, values.current);
 
 	// cut decimal places by cast to integer
 	d.first = static_cast<int>(d.first);
@@ -603,6 +1104,185 @@ float HCS::getMaxVoltage(void) {
 	return maxValues.first;
 }
 
+/**
+ * Passes a command to the I/O thread of the owning HCSManager. The response is
+ * converted on the I/O thread and delivered with the returned future.
+ */
+template<typename T, typename Convert>
+std::future<T> HCS::sendCommandAsync(const Protocol::Frame& cmd, Convert convert, const bool force)
+{
+	if(!manager){
+		throw std::runtime_error("can not send command <" + std::string(cmd.text()) + "> asynchronously. The device is not owned by a HCSManager");
+	}
+
+	auto result = std::make_shared<std::promise<T>>();
+	manager->post(*this, cmd, [result, convert](const std::string& response, std::exception_ptr error){
+		if(error){
+			result->set_exception(error);
+			return;
+		}
+		try{
+			convert(*result, response);
+		}catch (...) {
+			result->set_exception(std::current_exception());
+		}
+	}, force);
+	return result->get_future();
+}
+
+std::future<void> HCS::setVoltageAsync(const float voltage, const bool force)
+{
+	return sendCommandAsync<void>(voltageCommand(voltage), [](std::promise<void>& p, const std::string&){
+		p.set_value();
+	}, force);
+}
+
+std::future<void> HCS::setCurrentAsync(const float current, const bool force)
+{
+	return sendCommandAsync<void>(currentCommand(current), [](std::promise<void>& p, const std::string&){
+		p.set_value();
+	}, force);
+}
+
+std::future<std::string> HCS::getPresentVoltageAndCurrentAsync()
+{
+	return sendCommandAsync<std::string>(Protocol::encode<Protocol::Command::GETS>(), [](std::promise<std::string>& p, const std::string& voltCurr){
+		p.set_value(voltCurr);
+	});
+}
+
+std::future<std::string> HCS::readStatusAsync()
+{
+	return sendCommandAsync<std::string>(Protocol::encode<Protocol::Command::GETD>(), [this](std::promise<std::string>& p, const std::string& status){
+		p.set_value(toStatus(status));
+	});
+}
+
+size_t HCS::Batch::add(const Protocol::Frame& cmd, const bool force)
+{
+	commands.push_back({cmd, "", force});
+	return commands.size() - 1;
+}
+
+size_t HCS::Batch::setVoltage(const float voltage, const bool force)
+{
+	return add(hcs.voltageCommand(voltage), force);
+}
+
+size_t HCS::Batch::setCurrent(const float current, const bool force)
+{
+	return add(hcs.currentCommand(current), force);
+}
+
+size_t HCS::Batch::getMaxValues()
+{
+	return add(Protocol::encode<Protocol::Command::GMAX>());
+}
+
+size_t HCS::Batch::getPresentVoltageAndCurrent()
+{
+	return add(Protocol::encode<Protocol::Command::GETS>());
+}
+
+size_t HCS::Batch::getPresentUpperLimitVoltage()
+{
+	return add(Protocol::encode<Protocol::Command::GOVP>());
+}
+
+size_t HCS::Batch::getPresentUpperLimitCurrent()
+{
+	return add(Protocol::encode<Protocol::Command::GOCP>());
+}
+
+size_t HCS::Batch::readStatus()
+{
+	return add(Protocol::encode<Protocol::Command::GETD>());
+}
+
+/**
+ * Writes all commands at once and collects their responses.
+ * If a command fails after all its tries, the following commands are dropped.
+ * Setpoints, that the device already has, are not written, see HCS::elide().
+ */
+void HCS::Batch::execute()
+{
+	hcs.isConnected();
+
+	if(hcs.manager && hcs.manager->isRunning())
+	{
+		if(std::this_thread::get_id() == hcs.manager->ioThread.get_id()){
+			throw std::runtime_error("can not execute batch on <" + hcs.uart + ">. A blocking call on the I/O thread would wait for itself, use HCSManager::post()");
+		}
+		// the connection is owned by the I/O thread, which pipelines the commands
+		std::vector<HCSManager::Request> requests;
+		for(auto& c : commands){
+			requests.push_back({&hcs, c.cmd, "", c.force});
+		}
+
+		std::vector<std::future<std::string>> responses = hcs.manager->post(requests);
+		for(size_t i = 0; i < commands.size(); ++i){
+			commands[i].response = responses[i].get();
+		}
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(hcs.connectionMutex);
+		if(!hcs.transactions.empty()){
+			throw std::runtime_error("can not execute batch. Commands are still in progress");
+		}
+
+		std::vector<bool> sent(commands.size());
+		try{
+			for(size_t i = 0; i < commands.size(); ++i)
+			{
+				sent[i] = commands[i].force || !hcs.elide(commands[i].cmd);
+				if(sent[i]){
+					hcs.submit(commands[i].cmd);
+				}
+			}
+			hcs.transmit();
+
+			for(size_t i = 0; i < commands.size(); ++i){
+				commands[i].response = sent[i] ? hcs.awaitResponse() : "";
+			}
+		}catch (...) {
+			hcs.abort();
+			throw;
+		}
+	}
+
+	for(auto& c : commands)
+	{
+		if(c.cmd.command == Protocol::Command::GMAX){
+			hcs.maxValues = hcs.toMaxValues(c.response);
+			hcs.maxValuesCached = true;
+		}else if(c.cmd.command == Protocol::Command::GOVP){
+			if(!Protocol::decodeLimit(c.response, hcs.upperLimits.first)){
+				throw ExprectedReceiveError("malformed upper voltage limit <" + c.response + "> received via uart");
+			}
+		}else if(c.cmd.command == Protocol::Command::GOCP){
+			if(!Protocol::decodeLimit(c.response, hcs.upperLimits.second)){
+				throw ExprectedReceiveError("malformed upper current limit <" + c.response + "> received via uart");
+			}
+		}
+	}
+}
+
+const std::string& HCS::Batch::response(size_t i) const
+{
+	return commands.at(i).response;
+}
+
+size_t HCS::Batch::size() const
+{
+	return commands.size();
+}
+
+void HCS::Batch::clear()
+{
+	commands.clear();
+}
+
 #ifdef __MANSON_TEST
 void HCS::test(){
 		std::cout << "max voltage: " << getMaxVoltage() << "V\n";
@@ -9,23 +9,91 @@
 #ifndef HCS_H_
 #define HCS_H_
 
+#include <chrono>
 #include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <utility>	// std::pair
+#include <vector>
+
+#include "HCSMetrics.h"
+#include "HCSTimeout.h"
+#include "Protocol.h"
+#include "Serial.h"
+#include "Transport.h"
 
 //#define __MANSON_SIMULATION
 //#define __MANSON_DEBUG
 //#define __MANSON_TEST
 
+#ifdef __MANSON_SIMULATION
+#include "HCSSimulator.h"
+#endif
+
+class HCSManager;
+
 class HCS {
+	friend class HCSManager;
+	friend class HCSSampler;
+	friend class HCSGroup;
+	friend class HCSSweep;
+	friend class HCSProtection;
 private:
 	unsigned int baud;
 	std::string uart;
-	static int fd;
+	std::unique_ptr<Transport> transport;
 	std::pair<int,int> hcsData;	// <voltage, current>
 
-	static bool initialized;
+	// cached device state. maxValues and upperLimits are read once by init() and kept,
+	// until the connection changes or invalidate() is called
+	bool maxValuesCached;
+	bool upperLimitsCached;
+	std::string capabilityCache;	// file, that stores the GMAX response of the device
 	bool connected;
+	SerialReader rx;
+	HCSMetrics counters;
+	HCSTimeoutPolicy timeouts;
+	std::chrono::steady_clock::time_point answered;	// the last response was complete
+	std::chrono::steady_clock::time_point finishedWritten;	// written time of the command, that finish() returned last
+	HCSManager *manager;	// set, if the device is owned by a HCSManager
+	std::mutex connectionMutex;	// serializes blocking calls, while no I/O thread owns the connection
+#ifdef __MANSON_SIMULATION
+	std::unique_ptr<HCSSimulator> simulator;	// replaces the device, see connect()
+#endif
+
+	/**
+	 * A command on this connection. It is finished, when the response is
+	 * received or all tries failed, see service()
+	 */
+	struct Transaction {
+		enum class State {QUEUED, WAITING, BACKOFF, DONE, FAILED};
+
+		State state = State::QUEUED;
+		Protocol::Frame cmd;
+		unsigned int failures = 0x0;
+		std::chrono::steady_clock::time_point deadline;
+		std::chrono::steady_clock::time_point expires = std::chrono::steady_clock::time_point::max();	// see Deadline
+		std::string response;
+
+		// timestamps of the metrics, see HCSMetrics::Stage
+		std::chrono::steady_clock::time_point submitted;
+		std::chrono::steady_clock::time_point written;
+		std::chrono::steady_clock::time_point firstByte;
+	};
+	// commands in the order they were sent, the oldest one is answered next
+	std::deque<Transaction> transactions;
+	// responses of commands, that were written, but are sent again or dropped. They are
+	// received before the ones of transactions and skipped, see retry()
+	unsigned int stale = 0;
+
+	// the values of VOLT, CURR, SOVP and SOCP in 100mV/100mA, that the device acknowledged or reported last.
+	// A write of the same value is not sent, see elide(). Used by the thread, that owns the connection
+	static constexpr int SHADOWED = 4;
+	static constexpr int UNKNOWN = -1;
+	int shadow[SHADOWED] = {UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN};
 	int statusCC = 0x00;
 	int statusCV = 0x00;
 
@@ -59,40 +127,72 @@ private:
 	HCS& operator=(HCS &&other) = delete;
 
 	void uartDebug(const std::string& data);
-	bool receiveOk();
 	void verifyReceived(const std::string& receivedData, const std::string& errMsg);
 
 	bool isConnected(void);
-	std::string receiveViaUart(uint8_t byteCount);
-	int send(const std::string& msg);
-	std::string sendCommand(const std::string& msg, const uint8_t receiveBytesCount = 0x0, const bool expectOk = true);
+	SerialReader::Frame receiveViaUart(const bool readable);
+	void read();
+	bool skipStale();
+	bool receiving() const;
+	std::string sendCommand(const Protocol::Frame& cmd, const bool force = false);
+
+	// non blocking command processing, used by sendCommand() and HCSManager
+	void submit(const Protocol::Frame& cmd, const std::chrono::steady_clock::time_point expires = Deadline::current());
+	void begin(const Protocol::Frame& cmd);
+	void transmit();
+	void retry();
+	bool service(const bool readable);
+	std::string finish();
+	std::string awaitResponse();
+	void abort();
+
+	// write elision, see shadow
+	bool elide(const Protocol::Frame& cmd);
+	void acknowledge(const Protocol::Frame& cmd, const std::string& response);
+	void forget(const Protocol::Command c);
+
+	Protocol::Frame voltageCommand(const float voltage);
+	Protocol::Frame currentCommand(const float current);
+	std::string toStatus(const std::string& status);
+	Protocol::Measurement toDisplay(const std::string& status);
+
+	template<typename T, typename Convert>
+	std::future<T> sendCommandAsync(const Protocol::Frame& cmd, Convert convert, const bool force = false);
 
 	// ioctl functions
 	int getNumberBytesInSendBuffer();
 
 
 	MansonData getMaxValues();
-	MansonData toMansonData(std::string& voltageCurrentString);
+	MansonData toMaxValues(const std::string& gmax);
+	bool loadCapabilityCache();
+	void storeCapabilityCache(const std::string& gmax);
 
 public:
 	enum MEMORY {M0 = 0, M1, M2};
 
-	explicit HCS(std::string _uart, unsigned int _baud) : baud(_baud), uart(_uart), connected(false)
+	explicit HCS(std::string _uart, unsigned int _baud) : baud(_baud), uart(_uart), transport(new SerialTransport(_uart, _baud)), maxValuesCached(false), upperLimitsCached(false), connected(false), timeouts(_baud), manager(nullptr)
+	{
+	}
+	// runs the protocol over any transport, see Transport.h
+	explicit HCS(std::unique_ptr<Transport> _transport) : baud(_transport->baud()), uart(_transport->name()), transport(std::move(_transport)), maxValuesCached(false), upperLimitsCached(false), connected(false), timeouts(baud), manager(nullptr)
 	{
-		initialized = false;
 	}
 	virtual ~HCS() = default;
 	void init();
+	void invalidate();
+	void setCapabilityCache(const std::string& path);
 	void connect();
 	void disconnect(void);
 	void setDisconnected(void);
 	void setConnected(void);
 
-	void setVoltage(const float voltage);
-	void setUpperVoltageLimit(const float voltage);
+	// a setpoint or limit, that the device already has, is not sent again, unless force is set
+	void setVoltage(const float voltage, const bool force = false);
+	void setUpperVoltageLimit(const float voltage, const bool force = false);
 
-	void setCurrent(const float current);
-	void setUpperCurrentLimit(const float current);
+	void setCurrent(const float current, const bool force = false);
+	void setUpperCurrentLimit(const float current, const bool force = false);
 
 	float getMaxCurrent(void);
 	float getMaxVoltage(void);
@@ -100,39 +200,132 @@ public:
 	float getPresentUpperLimitCurrent(void);
 	std::string getPresentVoltageAndCurrent(bool printOutput = true);
 
-	void readMemoryValues();
+	Protocol::Presets readMemoryValues();
 	void runMemory(MEMORY m);
 	void setMemory(float v0, float c0, float v1, float c1, float v2, float c2);
 
 	std::string readStatus();
+	Protocol::Measurement readDisplay();
+
+	// asynchronous commands, processed by the I/O thread of the owning HCSManager.
+	// The HCSManager has to be started, see HCSManager::start()
+	std::future<void> setVoltageAsync(const float voltage, const bool force = false);
+	std::future<void> setCurrentAsync(const float current, const bool force = false);
+	std::future<std::string> getPresentVoltageAndCurrentAsync();
+	std::future<std::string> readStatusAsync();
 
 	void flush(void);
 
-	static bool isInitialized() {
-		return initialized;
+	// counters and latencies of this connection, see HCSMetrics
+	const HCSMetrics& metrics() const {
+		return counters;
+	}
+	void resetMetrics() {
+		counters.reset();
+	}
+
+	// response timeouts and retries of this connection. Set the options, before commands are sent
+	HCSTimeoutPolicy& timeoutPolicy() {
+		return timeouts;
+	}
+
+	/**
+	 * Limits the time of all commands, that the calling thread sends while it exists,
+	 * including their retries. A command, that is not answered until then, fails.
+	 * Nested deadlines can only shorten the time.
+	 *
+	 *	{
+	 *		HCS::Deadline d(std::chrono::milliseconds(50));
+	 *		h.readStatus();
+	 *	}
+	 */
+	class Deadline {
+	private:
+		std::chrono::steady_clock::time_point previous;
+
+		Deadline(const Deadline &other) = delete;
+		Deadline(Deadline &&other) = delete;
+		Deadline& operator=(const Deadline &other) = delete;
+		Deadline& operator=(Deadline &&other) = delete;
+
+	public:
+		explicit Deadline(const std::chrono::steady_clock::time_point t);
+		explicit Deadline(const std::chrono::steady_clock::duration budget) : Deadline(std::chrono::steady_clock::now() + budget) {}
+		virtual ~Deadline();
+
+		// the deadline of the calling thread, time_point::max() if there is none
+		static std::chrono::steady_clock::time_point current();
+	};
+
+	/**
+	 * Commands, that are written to the device with a single write().
+	 * The responses are matched to the commands in the order they were added,
+	 * a command with a missing response is resent with its own retries.
+	 * A command, whose response has the frame of the one before it (e.g. GOCP after
+	 * GOVP), is written after that response is received, so they are not confused.
+	 *
+	 *	HCS::Batch b(h);
+	 *	b.setVoltage(5.0f);
+	 *	size_t gets = b.getPresentVoltageAndCurrent();
+	 *	b.execute();
+	 *	std::string voltCurr = b.response(gets);
+	 */
+	class Batch {
+	private:
+		struct Command {
+			Protocol::Frame cmd;
+			std::string response;
+			bool force;
+		};
+
+		HCS& hcs;
+		std::vector<Command> commands;
+
+		size_t add(const Protocol::Frame& cmd, const bool force = false);
+
+	public:
+		explicit Batch(HCS& _hcs) : hcs(_hcs) {}
+
+		size_t setVoltage(const float voltage, const bool force = false);
+		size_t setCurrent(const float current, const bool force = false);
+		size_t getMaxValues();
+		size_t getPresentVoltageAndCurrent();
+		size_t getPresentUpperLimitVoltage();
+		size_t getPresentUpperLimitCurrent();
+		size_t readStatus();
+
+		void execute();
+		const std::string& response(size_t i) const;
+		size_t size() const;
+		void clear();
+	};
+
+	bool isInitialized() const {
+		return maxValuesCached && upperLimitsCached;
 	}
 
 	void test();
 
-//	const MansonData& getDisplayValue() const {
-//		return displayValue;
-//	}
-//
-//	const MansonData& getMemory1() const {
-//		return memory1;
-//	}
-//
-//	const MansonData& getMemory2() const {
-//		return memory2;
-//	}
-//
-//	const MansonData& getMemory3() const {
-//		return memory3;
-//	}
-//
-//	const MansonData& getUpperLimits() const {
-//		return upperLimits;
-//	}
+	// values of the last readStatus(), readDisplay(), readMemoryValues()
+	const MansonData& getDisplayValue() const {
+		return displayValue;
+	}
+
+	const MansonData& getMemory1() const {
+		return memory1;
+	}
+
+	const MansonData& getMemory2() const {
+		return memory2;
+	}
+
+	const MansonData& getMemory3() const {
+		return memory3;
+	}
+
+	const MansonData& getUpperLimits() const {
+		return upperLimits;
+	}
 };
 
 #endif /* HCS_H_ */
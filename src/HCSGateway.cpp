@@ -0,0 +1,474 @@
+/*
+ * HCSGateway.cpp
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#include "HCSGateway.h"
+#include "Log.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+static constexpr size_t maxLineLength = 256;
+static constexpr size_t maxOutput = 1 << 20;	// a client, that does not read its replies, is dropped
+
+HCSGateway::Completions::~Completions()
+{
+	if(event >= 0){
+		close(event);
+	}
+}
+
+HCSGateway::HCSGateway(HCSManager& _manager, Options _options) : manager(_manager), options(_options), devices(_manager.size())
+{
+	if(options.unixPath.empty() && options.tcpPort == 0){
+		throw std::runtime_error("gateway needs a Unix socket path or a TCP port");
+	}
+	options.pipelineDepth = std::max(options.pipelineDepth, 1u);
+
+	completions = std::make_shared<Completions>();
+	if((completions->event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 || (stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+	{
+		std::string msg = std::string(strerror(errno));
+		throw std::runtime_error("could not create eventfd for gateway: " + msg);
+	}
+}
+
+HCSGateway::~HCSGateway()
+{
+	stop();
+	close(stopFd);
+}
+
+/**
+ * Opens the listening sockets and starts the I/O thread of the manager, if it is not running
+ */
+void HCSGateway::listen()
+{
+	auto fail = [this](const std::string& what) {
+		std::string msg = std::string(strerror(errno));
+		for(int l : listeners){
+			close(l);
+		}
+		listeners.clear();
+		throw std::runtime_error(what + ": " + msg);
+	};
+
+	if(!options.unixPath.empty())
+	{
+		struct sockaddr_un address = {};
+		if(options.unixPath.length() >= sizeof(address.sun_path)){
+			throw std::runtime_error("socket path is too long <" + options.unixPath + ">");
+		}
+		address.sun_family = AF_UNIX;
+		std::strncpy(address.sun_path, options.unixPath.c_str(), sizeof(address.sun_path) - 1);
+
+		int l = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if(l < 0){
+			fail("could not create socket");
+		}
+		listeners.push_back(l);
+		unlink(options.unixPath.c_str());
+		if(bind(l, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0 || ::listen(l, 16) < 0){
+			fail("could not listen on <" + options.unixPath + ">");
+		}
+	}
+
+	if(options.tcpPort != 0)
+	{
+		struct sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(options.tcpPort);
+		if(inet_pton(AF_INET, options.tcpAddress.c_str(), &address.sin_addr) != 1){
+			throw std::runtime_error("invalid address <" + options.tcpAddress + ">");
+		}
+
+		int l = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if(l < 0){
+			fail("could not create socket");
+		}
+		listeners.push_back(l);
+		int one = 1;
+		setsockopt(l, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if(bind(l, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0 || ::listen(l, 16) < 0){
+			fail("could not listen on <" + options.tcpAddress + ":" + std::to_string(options.tcpPort) + ">");
+		}
+	}
+
+	if(!manager.isRunning()){
+		manager.start();
+	}
+}
+
+void HCSGateway::accept(const int listener)
+{
+	const int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if(fd < 0){
+		return;
+	}
+	if(clients.size() >= options.maxClients)
+	{
+		MANSON_LOG_WARN("gateway rejected a client, the limit of <" << options.maxClients << "> clients is reached");
+		close(fd);
+		return;
+	}
+
+	// replies are small, they are sent immediately. Fails on a Unix socket, which has no delay
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	clients.push_back({fd, "", "", {}});
+	connected = clients.size();
+	MANSON_LOG_INFO("gateway accepted client <" << fd << ">");
+}
+
+/**
+ * Reads the requests of a client. returns false, if the client has to be closed
+ */
+bool HCSGateway::receive(Client& client)
+{
+	char buf[4096];
+	const ssize_t n = recv(client.fd, buf, sizeof(buf), MSG_DONTWAIT);
+	if(n == 0){
+		return false;
+	}
+	if(n < 0){
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+	}
+
+	client.in.append(buf, n);
+	size_t start = 0;
+	for(size_t end; (end = client.in.find('\n', start)) != std::string::npos; start = end + 1)
+	{
+		std::string line = client.in.substr(start, end - start);
+		if(!line.empty() && line.back() == '\r'){
+			line.pop_back();
+		}
+		if(!line.empty()){
+			request(client, line);
+		}
+	}
+	client.in.erase(0, start);
+
+	return client.in.length() <= maxLineLength;
+}
+
+/**
+ * Parses "<device> <command>" and queues the command or attaches the reply to an
+ * identical read, that is waiting or in progress
+ */
+void HCSGateway::request(Client& client, const std::string& line)
+{
+	++requests;
+	auto reply = std::make_shared<Reply>();
+	client.replies.push_back(reply);
+
+	size_t device = 0;
+	const char *begin = line.data();
+	const char *end = line.data() + line.length();
+	std::from_chars_result r = std::from_chars(begin, end, device);
+
+	auto error = [&reply, &r, begin](const std::string& msg) {
+		reply->text = ((r.ptr == begin) ? std::string("?") : std::string(begin, r.ptr)) + " ERR " + msg + "\n";
+		reply->ready = true;
+	};
+
+	if(r.ec != std::errc() || r.ptr == end || *r.ptr != ' '){
+		r.ptr = begin;
+		error("expected: <device> <command>");
+		return;
+	}
+	if(device >= devices.size()){
+		error("there are <" + std::to_string(devices.size()) + "> devices");
+		return;
+	}
+
+	std::string_view text(r.ptr, end - r.ptr);
+	text.remove_prefix(std::min(text.find_first_not_of(' '), text.length()));
+	Protocol::Frame cmd;
+	if(!Protocol::decodeCommand(text, cmd)){
+		error("invalid command <" + std::string(text) + ">");
+		return;
+	}
+
+	Device& d = devices[device];
+	const bool read = cmd.spec().responseLength > 0;
+
+	if(read)
+	{
+		auto same = [&cmd, &d](const std::shared_ptr<Operation>& op) {
+			return op->generation == d.generation && op->cmd.text() == cmd.text();
+		};
+		auto waiting = std::find_if(d.telemetry.begin(), d.telemetry.end(), same);
+		auto running = std::find_if(d.inFlight.begin(), d.inFlight.end(), same);
+		std::shared_ptr<Operation> op = (waiting != d.telemetry.end()) ? *waiting : (running != d.inFlight.end()) ? *running : nullptr;
+		if(op)
+		{
+			op->waiters.push_back(reply);
+			++coalesced;
+			return;
+		}
+	}
+
+	auto op = std::make_shared<Operation>();
+	op->device = device;
+	op->cmd = cmd;
+	op->generation = d.generation;
+	op->waiters.push_back(reply);
+
+	if(read){
+		d.telemetry.push_back(op);
+	}else{
+		d.control.push_back(op);
+		++d.generation;
+	}
+	dispatch(device);
+}
+
+/**
+ * Posts the next commands of a device to the I/O thread of the manager, control commands first
+ */
+void HCSGateway::dispatch(const size_t device)
+{
+	Device& d = devices[device];
+
+	while(d.inFlight.size() < options.pipelineDepth && !(d.control.empty() && d.telemetry.empty()))
+	{
+		std::deque<std::shared_ptr<Operation>>& queue = d.control.empty() ? d.telemetry : d.control;
+		std::shared_ptr<Operation> op = queue.front();
+		queue.pop_front();
+		d.inFlight.push_back(op);
+		++transactions;
+
+		std::shared_ptr<Completions> c = completions;
+		auto done = [c, op](const std::string& response, std::exception_ptr error) {
+			op->response = response;
+			op->error = error;
+			{
+				std::lock_guard<std::mutex> lock(c->mutex);
+				c->done.push_back(op);
+			}
+			uint64_t one = 1;
+			ssize_t ret = write(c->event, &one, sizeof(one));
+			(void)ret;
+		};
+
+		try{
+			manager.post(manager[device], op->cmd, done);
+		}catch (...) {
+			done("", std::current_exception());
+		}
+	}
+}
+
+/**
+ * Passes the response of a finished operation to all its waiters
+ */
+void HCSGateway::complete(const std::shared_ptr<Operation>& op)
+{
+	Device& d = devices[op->device];
+	d.inFlight.erase(std::remove(d.inFlight.begin(), d.inFlight.end(), op), d.inFlight.end());
+
+	std::string text = std::to_string(op->device) + " ";
+	if(op->error)
+	{
+		try{
+			std::rethrow_exception(op->error);
+		}catch (std::exception& e) {
+			text += "ERR " + std::string(e.what());
+		}catch (...) {
+			text += "ERR unknown error";
+		}
+		text.erase(std::remove(text.begin(), text.end(), '\n'), text.end());
+	}
+	else if(op->response.empty())
+	{
+		text += "OK";
+	}
+	else
+	{
+		// GETM separates its presets with \r
+		std::string payload = op->response;
+		std::replace(payload.begin(), payload.end(), '\r', ',');
+		text += payload;
+	}
+	text += "\n";
+
+	for(auto& reply : op->waiters)
+	{
+		reply->text = text;
+		reply->ready = true;
+	}
+	dispatch(op->device);
+}
+
+/**
+ * Sends the replies of a client, that are ready, in the order of its requests
+ */
+void HCSGateway::flush(Client& client)
+{
+	while(!client.replies.empty() && client.replies.front()->ready)
+	{
+		client.out += client.replies.front()->text;
+		client.replies.pop_front();
+	}
+	if(client.out.empty()){
+		return;
+	}
+
+	const ssize_t n = send(client.fd, client.out.data(), client.out.length(), MSG_DONTWAIT | MSG_NOSIGNAL);
+	if(n > 0){
+		client.out.erase(0, n);
+	}
+}
+
+void HCSGateway::loop()
+{
+	std::vector<struct pollfd> fds;
+	std::vector<std::shared_ptr<Operation>> done;
+
+	while(running)
+	{
+		fds.clear();
+		fds.push_back({stopFd, POLLIN, 0});
+		fds.push_back({completions->event, POLLIN, 0});
+		for(int l : listeners){
+			fds.push_back({l, POLLIN, 0});
+		}
+		const size_t first = fds.size();
+		for(const Client& c : clients){
+			fds.push_back({c.fd, static_cast<short>(POLLIN | (c.out.empty() ? 0 : POLLOUT)), 0});
+		}
+
+		if(poll(fds.data(), fds.size(), -1) < 0)
+		{
+			if(errno == EINTR){
+				continue;
+			}
+			MANSON_LOG_ERROR("gateway poll failed: " << strerror(errno));
+			break;
+		}
+
+		if(fds[1].revents & POLLIN)
+		{
+			uint64_t count;
+			ssize_t ret = read(completions->event, &count, sizeof(count));
+			(void)ret;
+			{
+				std::lock_guard<std::mutex> lock(completions->mutex);
+				done.swap(completions->done);
+			}
+			for(auto& op : done){
+				complete(op);
+			}
+			done.clear();
+		}
+
+		std::vector<size_t> closed;
+		for(size_t i = 0; i < clients.size(); ++i)
+		{
+			const short revents = fds[first + i].revents;
+			if((revents & (POLLIN | POLLHUP | POLLERR)) && !receive(clients[i])){
+				closed.push_back(i);
+			}
+		}
+		for(size_t i = 0; i < clients.size(); ++i)
+		{
+			flush(clients[i]);
+			if(clients[i].out.length() > maxOutput && std::find(closed.begin(), closed.end(), i) == closed.end()){
+				closed.push_back(i);
+			}
+		}
+
+		std::sort(closed.begin(), closed.end());
+		for(auto it = closed.rbegin(); it != closed.rend(); ++it)
+		{
+			MANSON_LOG_INFO("gateway closed client <" << clients[*it].fd << ">");
+			close(clients[*it].fd);
+			clients.erase(clients.begin() + *it);
+		}
+
+		// new clients are accepted after the indices of fds are used
+		for(size_t i = 2; i < first; ++i)
+		{
+			if(fds[i].revents & POLLIN){
+				accept(fds[i].fd);
+			}
+		}
+		connected = clients.size();
+	}
+
+	for(Client& c : clients){
+		close(c.fd);
+	}
+	clients.clear();
+	for(int l : listeners){
+		close(l);
+	}
+	listeners.clear();
+	if(!options.unixPath.empty()){
+		unlink(options.unixPath.c_str());
+	}
+	connected = 0;
+}
+
+void HCSGateway::run()
+{
+	if(running.exchange(true)){
+		throw std::runtime_error("gateway is already running");
+	}
+	try{
+		listen();
+	}catch (...) {
+		running = false;
+		throw;
+	}
+	loop();
+}
+
+void HCSGateway::start()
+{
+	if(running.exchange(true)){
+		throw std::runtime_error("gateway is already running");
+	}
+	try{
+		listen();
+	}catch (...) {
+		running = false;
+		throw;
+	}
+	worker = std::thread(&HCSGateway::loop, this);
+}
+
+void HCSGateway::stop()
+{
+	if(running.exchange(false))
+	{
+		uint64_t one = 1;
+		ssize_t ret = write(stopFd, &one, sizeof(one));
+		(void)ret;
+	}
+	if(worker.joinable()){
+		worker.join();
+	}
+}
+
+HCSGateway::Statistics HCSGateway::statistics() const
+{
+	return {requests, transactions, coalesced, connected};
+}
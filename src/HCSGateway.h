@@ -0,0 +1,139 @@
+/*
+ * HCSGateway.h
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#ifndef HCSGATEWAY_H_
+#define HCSGATEWAY_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "HCSManager.h"
+#include "Protocol.h"
+
+/**
+ * Serves the devices of a HCSManager to many clients over a Unix and/or TCP socket,
+ * so several processes can share the supplies.
+ *
+ * A client sends one request per line, a device index and a command of the UART protocol.
+ * The replies are sent in the order of the requests:
+ *
+ *	0 GETS			->	0 050010
+ *	1 VOLT120		->	1 OK
+ *	0 GETM			->	0 050010,120015,240020
+ *	2 GETS			->	2 ERR <message>
+ *
+ * Identical reads (GMAX, GETS, GETD, GOVP, GOCP, GETM) of one device, that are waiting or in
+ * progress at the same time, are coalesced into a single transaction, unless a control
+ * command was queued in between. Control commands are sent before waiting reads.
+ */
+class HCSGateway {
+public:
+	struct Options {
+		std::string unixPath;					// path of the Unix socket, empty disables it
+		std::string tcpAddress = "127.0.0.1";
+		unsigned short tcpPort = 0;				// 0 disables TCP
+		unsigned int pipelineDepth = 1;			// commands in flight per device
+		size_t maxClients = 64;
+	};
+
+	struct Statistics {
+		uint64_t requests;
+		uint64_t transactions;	// commands sent to the devices
+		uint64_t coalesced;		// reads, that were answered by the transaction of another read
+		uint64_t clients;		// connected clients
+	};
+
+private:
+	// the reply to one request, sent when all replies before it are ready
+	struct Reply {
+		bool ready = false;
+		std::string text;
+	};
+
+	struct Operation {
+		size_t device;
+		Protocol::Frame cmd;
+		uint64_t generation;		// control commands of the device queued before it
+		std::vector<std::shared_ptr<Reply>> waiters;
+		std::string response;
+		std::exception_ptr error;
+	};
+
+	struct Device {
+		std::deque<std::shared_ptr<Operation>> control;
+		std::deque<std::shared_ptr<Operation>> telemetry;
+		std::vector<std::shared_ptr<Operation>> inFlight;
+		uint64_t generation = 0;
+	};
+
+	struct Client {
+		int fd;
+		std::string in;
+		std::string out;
+		std::deque<std::shared_ptr<Reply>> replies;
+	};
+
+	// finished operations, passed from the I/O thread of the manager.
+	// It is shared with the callbacks, which may outlive the gateway
+	struct Completions {
+		std::mutex mutex;
+		std::vector<std::shared_ptr<Operation>> done;
+		int event = -1;
+		~Completions();
+	};
+
+	HCSManager& manager;
+	Options options;
+	std::vector<Device> devices;
+	std::vector<Client> clients;
+	std::vector<int> listeners;
+	std::shared_ptr<Completions> completions;
+	int stopFd = -1;
+
+	std::thread worker;
+	std::atomic<bool> running{false};
+	std::atomic<uint64_t> requests{0};
+	std::atomic<uint64_t> transactions{0};
+	std::atomic<uint64_t> coalesced{0};
+	std::atomic<size_t> connected{0};
+
+	void listen();
+	void accept(const int listener);
+	bool receive(Client& client);
+	void request(Client& client, const std::string& line);
+	void dispatch(const size_t device);
+	void complete(const std::shared_ptr<Operation>& op);
+	void flush(Client& client);
+	void loop();
+
+	HCSGateway(const HCSGateway &other) = delete;
+	HCSGateway(HCSGateway &&other) = delete;
+	HCSGateway& operator=(const HCSGateway &other) = delete;
+	HCSGateway& operator=(HCSGateway &&other) = delete;
+
+public:
+	HCSGateway(HCSManager& _manager, Options _options);
+	virtual ~HCSGateway();
+
+	// opens the sockets and serves the clients until stop() is called.
+	// The I/O thread of the manager is started, if it is not running
+	void run();
+	// runs the gateway on a thread
+	void start();
+	void stop();
+
+	Statistics statistics() const;
+};
+
+#endif /* HCSGATEWAY_H_ */
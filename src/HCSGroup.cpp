@@ -0,0 +1,424 @@
+/*
+ * HCSGroup.cpp
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#include "HCSGroup.h"
+#include "Log.h"
+
+#include <poll.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+HCSGroup::HCSGroup(HCSManager& _manager) : manager(_manager), timeline("group")
+{
+}
+
+// the player uses the ticks, it is stopped before they are destroyed
+HCSGroup::~HCSGroup()
+{
+	stop();
+}
+
+/**
+ * Sets all rails with one tick. Throws, after all rails are finished, if one of them failed
+ */
+HCSGroup::Skew HCSGroup::set(const std::vector<float>& voltages, const std::vector<float>& currents)
+{
+	if(voltages.size() != manager.size() || currents.size() > manager.size()){
+		throw std::runtime_error("expected <" + std::to_string(manager.size()) + "> values per channel, but got <" + std::to_string(voltages.size()) + "> voltages and <" + std::to_string(currents.size()) + "> currents");
+	}
+
+	// all values are validated, before anything is sent
+	Tick tick{std::chrono::milliseconds(0), {}};
+	for(size_t i = 0; i < voltages.size(); ++i)
+	{
+		Rail& r = rail(tick, i);
+		if(voltages[i] != KEEP){
+			r.cmds.push_back(r.device->voltageCommand(voltages[i]));
+		}
+		if(i < currents.size() && currents[i] != KEEP){
+			r.cmds.push_back(r.device->currentCommand(currents[i]));
+		}
+	}
+	tick.rails.erase(std::remove_if(tick.rails.begin(), tick.rails.end(), [](const Rail& r){ return r.cmds.empty(); }), tick.rails.end());
+
+	execute(tick);
+	for(size_t i = 0; i < tick.rails.size(); ++i)
+	{
+		if(!tick.rails[i].ok){
+			throw std::runtime_error("could not set rail <" + tick.rails[i].device->uart + "> of group");
+		}
+	}
+	return measure(tick);
+}
+
+void HCSGroup::add(std::chrono::milliseconds offset, size_t rail, float voltage, float current)
+{
+	if(rail >= manager.size()){
+		throw std::runtime_error("rail <" + std::to_string(rail) + "> is not a device of the HCSManager");
+	}
+	sequence.push_back({offset, rail, voltage, current});
+	prepared = false;
+}
+
+void HCSGroup::powerUp(std::chrono::milliseconds start, const std::vector<size_t>& order, std::chrono::milliseconds delay,
+		const std::vector<float>& voltages, const std::vector<float>& currents)
+{
+	if(voltages.size() != order.size() || (!currents.empty() && currents.size() != order.size())){
+		throw std::runtime_error("expected <" + std::to_string(order.size()) + "> values per channel for the power up sequence");
+	}
+	for(size_t k = 0; k < order.size(); ++k){
+		add(start + delay * k, order[k], voltages[k], currents.empty() ? KEEP : currents[k]);
+	}
+}
+
+void HCSGroup::clear()
+{
+	sequence.clear();
+	prepared = false;
+}
+
+const std::vector<HCSGroup::Step>& HCSGroup::steps() const
+{
+	return sequence;
+}
+
+/**
+ * returns the commands of device index in tick, they are added on first use
+ */
+HCSGroup::Rail& HCSGroup::rail(Tick& tick, const size_t index)
+{
+	HCS *device = manager.devices[index].get();
+	auto r = std::find_if(tick.rails.begin(), tick.rails.end(), [device](const Rail& r){ return r.device == device; });
+	if(r != tick.rails.end()){
+		return *r;
+	}
+	tick.rails.push_back({device, {}, {}});
+	return tick.rails.back();
+}
+
+void HCSGroup::encode(Tick& tick, const size_t step)
+{
+	const Step& s = sequence[step];
+	Rail& r = rail(tick, s.rail);
+
+	if(s.voltage != KEEP)
+	{
+		r.cmds.push_back(r.device->voltageCommand(s.voltage));
+		r.steps.push_back(step);
+	}
+	if(s.current != KEEP)
+	{
+		r.cmds.push_back(r.device->currentCommand(s.current));
+		r.steps.push_back(step);
+	}
+}
+
+/**
+ * Sorts the steps by offset and encodes the commands of each offset into one tick.
+ * A setpoint, that exceeds the limits of a device, throws before anything is sent.
+ */
+void HCSGroup::prepare()
+{
+	std::stable_sort(sequence.begin(), sequence.end(), [](const Step& a, const Step& b){ return a.offset < b.offset; });
+
+	ticks.clear();
+	for(size_t i = 0; i < sequence.size(); ++i)
+	{
+		if(i == 0 || sequence[i].offset != sequence[i - 1].offset){
+			ticks.push_back({sequence[i].offset, {}});
+		}
+		encode(ticks.back(), i);
+	}
+
+	applied.clear();
+	applied.reserve(sequence.size());
+	measured.clear();
+	measured.reserve(ticks.size());
+	prepared = true;
+}
+
+/**
+ * Sends the commands of a tick. A failed rail is logged and marked, the others are finished
+ */
+void HCSGroup::execute(Tick& tick)
+{
+	for(auto& r : tick.rails)
+	{
+		r.sent = 0;
+		r.acknowledged = 0;
+		r.ok = true;
+	}
+
+	if(manager.isRunning()){
+		post(tick);
+	}else{
+		transact(tick);
+	}
+}
+
+/**
+ * Writes the commands of each rail with one write(), all rails in one pass, and
+ * receives the responses of all rails in one event loop.
+ */
+void HCSGroup::transact(Tick& tick)
+{
+	// the devices are locked in the order of their addresses, like by HCSManager::transact()
+	std::vector<Rail*> pending;
+	for(auto& r : tick.rails){
+		pending.push_back(&r);
+	}
+	std::sort(pending.begin(), pending.end(), [](const Rail *a, const Rail *b){ return a->device < b->device; });
+	std::vector<std::unique_lock<std::mutex>> locks;
+	for(Rail *r : pending){
+		locks.emplace_back(r->device->connectionMutex);
+	}
+
+	auto fail = [](Rail& r, const std::string& what) {
+		MANSON_LOG_ERROR("rail <" << r.device->uart << "> of group failed: " << what);
+		r.device->abort();
+		r.ok = false;
+	};
+
+	for(Rail *r : pending)
+	{
+		if(!r->device->transactions.empty())
+		{
+			MANSON_LOG_ERROR("rail <" << r->device->uart << "> of group failed: commands are still in progress");
+			r->ok = false;
+			continue;
+		}
+		try{
+			r->device->isConnected();
+			for(auto& cmd : r->cmds){
+				r->device->submit(cmd);
+			}
+		}catch (std::exception& e) {
+			fail(*r, e.what());
+		}
+	}
+
+	// nothing is received, before every rail is written
+	for(Rail *r : pending)
+	{
+		if(!r->ok){
+			continue;
+		}
+		try{
+			r->device->transmit();
+			r->sent = HCSTimeline::toNanoseconds(r->device->transactions.front().written);
+		}catch (std::exception& e) {
+			fail(*r, e.what());
+		}
+	}
+	pending.erase(std::remove_if(pending.begin(), pending.end(), [](const Rail *r){ return !r->ok; }), pending.end());
+
+	std::vector<struct pollfd> fds;
+	while(!pending.empty())
+	{
+		auto next = std::chrono::steady_clock::time_point::max();
+		fds.resize(pending.size());
+
+		for(size_t i = 0; i < pending.size(); ++i)
+		{
+			const HCS::Transaction& t = pending[i]->device->transactions.front();
+			fds[i] = {pending[i]->device->receiving() ? pending[i]->device->transport->descriptor() : -1, POLLIN, 0};
+			next = std::min(next, t.deadline);
+		}
+
+		auto timeout = std::chrono::ceil<std::chrono::milliseconds>(next - std::chrono::steady_clock::now()).count();
+		if(poll(fds.data(), fds.size(), std::max<int>(timeout, 0)) < 0 && errno != EINTR)
+		{
+			std::string msg = std::string(strerror(errno));
+			for(Rail *r : pending){
+				fail(*r, "poll failed for usart: " + msg);
+			}
+			return;
+		}
+
+		for(size_t i = 0; i < pending.size(); ++i)
+		{
+			Rail& r = *pending[i];
+			bool readable = fds[i].revents & (POLLIN | POLLERR | POLLHUP);
+			try{
+				while(!r.device->transactions.empty() && r.device->service(readable))
+				{
+					readable = false;
+					r.device->finish();
+				}
+			}catch (std::exception& e) {
+				fail(r, e.what());
+			}
+			if(r.device->transactions.empty()){
+				r.acknowledged = HCSTimeline::toNanoseconds(std::chrono::steady_clock::now());
+			}
+		}
+
+		pending.erase(std::remove_if(pending.begin(), pending.end(), [](const Rail *r){ return r->device->transactions.empty(); }), pending.end());
+	}
+}
+
+/**
+ * Passes the commands of all rails to the I/O thread at once. It admits them in one
+ * pass, so the commands of each rail are written with one write()
+ */
+void HCSGroup::post(Tick& tick)
+{
+	struct Completion {
+		std::mutex mutex;
+		std::condition_variable done;
+		size_t left = 0;
+	};
+	auto completion = std::make_shared<Completion>();
+	const auto expires = HCS::Deadline::current();
+
+	std::vector<HCSManager::Job> jobs;
+	for(auto& r : tick.rails)
+	{
+		for(auto& cmd : r.cmds)
+		{
+			Rail *rail = &r;
+			jobs.push_back({r.device, cmd, [completion, rail](const std::string&, std::exception_ptr error){
+				const int64_t acknowledged = HCSTimeline::toNanoseconds(std::chrono::steady_clock::now());
+				// on the I/O thread, right after HCS::finish() of the command
+				const auto written = rail->device->finishedWritten;
+				std::lock_guard<std::mutex> lock(completion->mutex);
+				if(!error && (rail->sent == 0 || HCSTimeline::toNanoseconds(written) < rail->sent)){
+					rail->sent = HCSTimeline::toNanoseconds(written);
+				}
+				if(error)
+				{
+					try{
+						std::rethrow_exception(error);
+					}catch (std::exception& e) {
+						MANSON_LOG_ERROR("rail <" << rail->device->uart << "> of group failed: " << e.what());
+					}
+					rail->ok = false;
+				}
+				rail->acknowledged = acknowledged;
+				if(--completion->left == 0){
+					completion->done.notify_all();
+				}
+			}, expires, true, Protocol::priority(cmd.command)});
+		}
+	}
+
+	completion->left = jobs.size();
+	try{
+		manager.enqueue(jobs);
+	}catch (std::exception& e) {
+		MANSON_LOG_ERROR("group could not be sent: " << e.what());
+		for(auto& r : tick.rails){
+			r.ok = false;
+		}
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(completion->mutex);
+	completion->done.wait(lock, [&completion]{ return completion->left == 0; });
+}
+
+HCSGroup::Skew HCSGroup::measure(const Tick& tick) const
+{
+	Skew skew{tick.offset, 0, 0, 0};
+	int64_t first[2] = {INT64_MAX, INT64_MAX};
+	int64_t last[2] = {INT64_MIN, INT64_MIN};
+
+	for(auto& r : tick.rails)
+	{
+		if(!r.ok){
+			continue;
+		}
+		++skew.rails;
+		first[0] = std::min(first[0], r.sent);
+		last[0] = std::max(last[0], r.sent);
+		first[1] = std::min(first[1], r.acknowledged);
+		last[1] = std::max(last[1], r.acknowledged);
+	}
+	if(skew.rails > 0)
+	{
+		skew.sent = last[0] - first[0];
+		skew.acknowledged = last[1] - first[1];
+	}
+	return skew;
+}
+
+void HCSGroup::play()
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	for(auto& tick : ticks)
+	{
+		const auto scheduled = start + tick.offset;
+		if(!timeline.waitUntil(scheduled)){
+			break;
+		}
+
+		execute(tick);
+		for(auto& r : tick.rails)
+		{
+			for(size_t s : r.steps)
+			{
+				// a step with voltage and current is applied once
+				if(applied.empty() || applied.back().step != s){
+					applied.push_back({s, HCSTimeline::toNanoseconds(scheduled), r.sent, r.acknowledged, r.ok});
+				}
+			}
+		}
+		measured.push_back(measure(tick));
+	}
+
+	std::sort(applied.begin(), applied.end(), [](const Applied& a, const Applied& b){ return a.step < b.step; });
+}
+
+/**
+ * Prepares a run, it is called by the timeline
+ */
+void HCSGroup::reset()
+{
+	if(!prepared){
+		prepare();
+	}
+	applied.clear();
+	measured.clear();
+}
+
+void HCSGroup::run()
+{
+	timeline.run([this]{ reset(); }, [this]{ play(); });
+}
+
+void HCSGroup::start()
+{
+	timeline.start([this]{ reset(); }, [this]{ play(); });
+}
+
+void HCSGroup::stop()
+{
+	timeline.stop();
+}
+
+void HCSGroup::wait()
+{
+	timeline.wait();
+}
+
+const std::vector<HCSGroup::Applied>& HCSGroup::result() const
+{
+	return applied;
+}
+
+const std::vector<HCSGroup::Skew>& HCSGroup::skews() const
+{
+	return measured;
+}
@@ -0,0 +1,133 @@
+/*
+ * HCSGroup.h
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#ifndef HCSGROUP_H_
+#define HCSGROUP_H_
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "HCSManager.h"
+#include "HCSTimeline.h"
+
+/**
+ * Sets the supplies (rails) of a HCSManager together, e.g. the rails of a DUT.
+ *
+ * The commands of all rails are encoded and validated against the limits of the devices,
+ * before anything is sent. Then the first command of each rail is written, the rails one
+ * after another in the same pass of one event loop, and the responses are
+ * received concurrently. The skew between the rails is measured on every tick.
+ *
+ *	HCSGroup g(m);
+ *	HCSGroup::Skew s = g.set({5.0f, 3.3f, 12.0f});	// one voltage per rail
+ *
+ * Power-up sequences are steps on an absolute timeline, like HCSSequence. Steps at the
+ * same offset are sent together:
+ *
+ *	g.add(std::chrono::milliseconds(0), 1, 3.3f, 0.5f);		// rail 1 first
+ *	g.powerUp(std::chrono::milliseconds(10), {0, 2}, std::chrono::milliseconds(5), {5.0f, 12.0f});
+ *	g.run();
+ *	for(auto& s : g.skews()) { ... }
+ *
+ * Setpoints are always sent, see HCS::elide(), so every rail of a tick is written.
+ * With a running HCSManager the commands of a tick are passed to its I/O thread at once.
+ * sent is the time the first command of a rail was written, in both cases. The current of
+ * a rail follows its voltage, when the OK of the voltage is received (see HCS::transmit()).
+ */
+class HCSGroup {
+public:
+	static constexpr float KEEP = HCSTimeline::KEEP;
+	using Applied = HCSTimeline::Applied;
+
+	struct Step {
+		std::chrono::milliseconds offset;
+		size_t rail;			// index of the device in the HCSManager
+		float voltage;
+		float current;
+	};
+
+	// spread between the first and the last rail of a tick in ns
+	struct Skew {
+		std::chrono::milliseconds offset;
+		size_t rails;
+		int64_t sent;
+		int64_t acknowledged;
+	};
+
+private:
+	// commands of one rail in a tick
+	struct Rail {
+		HCS *device;
+		std::vector<Protocol::Frame> cmds;
+		std::vector<size_t> steps;	// step of each command
+		int64_t sent = 0;
+		int64_t acknowledged = 0;
+		bool ok = true;
+	};
+
+	// steps at the same offset
+	struct Tick {
+		std::chrono::milliseconds offset;
+		std::vector<Rail> rails;
+	};
+
+	HCSManager& manager;
+	std::vector<Step> sequence;
+	std::vector<Tick> ticks;			// encoded by prepare()
+	std::vector<Applied> applied;
+	std::vector<Skew> measured;
+	bool prepared = false;
+	HCSTimeline timeline;
+
+	Rail& rail(Tick& tick, const size_t index);
+	void encode(Tick& tick, const size_t step);
+	void execute(Tick& tick);
+	void transact(Tick& tick);
+	void post(Tick& tick);
+	Skew measure(const Tick& tick) const;
+	void reset();
+	void play();
+
+	HCSGroup(const HCSGroup &other) = delete;
+	HCSGroup(HCSGroup &&other) = delete;
+	HCSGroup& operator=(const HCSGroup &other) = delete;
+	HCSGroup& operator=(HCSGroup &&other) = delete;
+
+public:
+	explicit HCSGroup(HCSManager& _manager);
+	virtual ~HCSGroup();
+
+	// sets the rails now, one value per rail. KEEP or a missing current keeps the value
+	Skew set(const std::vector<float>& voltages, const std::vector<float>& currents = {});
+
+	void add(std::chrono::milliseconds offset, size_t rail, float voltage, float current = KEEP);
+	// the rails in order, the first one at start, each following one delay later. values are in the same order
+	void powerUp(std::chrono::milliseconds start, const std::vector<size_t>& order, std::chrono::milliseconds delay,
+			const std::vector<float>& voltages, const std::vector<float>& currents = {});
+	void clear();
+	const std::vector<Step>& steps() const;
+
+	// encodes all commands. It is called by run(), if the sequence was changed
+	void prepare();
+
+	// plays the sequence and blocks until the last step is applied or stop() is called
+	void run();
+	// plays the sequence on a thread
+	void start();
+	void stop();
+	void wait();
+
+	// one entry per applied step, in the order of the steps
+	const std::vector<Applied>& result() const;
+	// one entry per tick of the last run
+	const std::vector<Skew>& skews() const;
+};
+
+#endif /* HCSGROUP_H_ */
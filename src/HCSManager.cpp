@@ -0,0 +1,652 @@
+/*
+ * HCSManager.cpp
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#include "HCSManager.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <stdexcept>
+
+HCSManager::~HCSManager()
+{
+	stop();
+}
+
+HCS& HCSManager::add(const std::string& uart, unsigned int baud)
+{
+	if(isRunning()){
+		throw std::runtime_error("can not add device <" + uart + "> while the I/O thread is running");
+	}
+	devices.push_back(std::make_unique<HCS>(uart, baud));
+	devices.back()->manager = this;
+	return *devices.back();
+}
+
+HCS& HCSManager::add(std::unique_ptr<Transport> transport)
+{
+	if(isRunning()){
+		throw std::runtime_error("can not add device <" + transport->name() + "> while the I/O thread is running");
+	}
+	devices.push_back(std::make_unique<HCS>(std::move(transport)));
+	devices.back()->manager = this;
+	return *devices.back();
+}
+
+size_t HCSManager::size() const
+{
+	return devices.size();
+}
+
+HCS& HCSManager::operator[](size_t i)
+{
+	return *devices.at(i);
+}
+
+void HCSManager::connect()
+{
+	for(auto& d : devices){
+		d->connect();
+	}
+}
+
+void HCSManager::disconnect()
+{
+	stop();
+	for(auto& d : devices){
+		d->disconnect();
+	}
+}
+
+void HCSManager::start()
+{
+	if(isRunning()){
+		return;
+	}
+
+	if((wakeFd = eventfd(0, EFD_NONBLOCK)) < 0)
+	{
+		std::string msg = std::string(strerror(errno));
+		throw std::runtime_error("could not create eventfd for I/O thread: " + msg);
+	}
+
+	queues = std::vector<Queue>(devices.size());
+	running = true;
+	ioThread = std::thread(&HCSManager::ioLoop, this);
+}
+
+/**
+ * Stops the I/O thread. Commands, which are still in progress, fail.
+ */
+void HCSManager::stop()
+{
+	if(!ioThread.joinable()){
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		running = false;
+	}
+	space.notify_all();
+	uint64_t one = 1;
+	if(write(wakeFd, &one, sizeof(one)) < 0){
+		// the loop notices running == false with its next timeout
+	}
+	ioThread.join();
+
+	close(wakeFd);
+	wakeFd = -1;
+}
+
+bool HCSManager::isRunning() const
+{
+	return running;
+}
+
+/**
+ * Passes a command to the I/O thread. done is called on the I/O thread,
+ * when the command is finished.
+ */
+void HCSManager::post(HCS& device, const Protocol::Frame& cmd, Callback done, const bool force)
+{
+	post(device, cmd, std::move(done), force, Protocol::priority(cmd.command));
+}
+
+void HCSManager::post(HCS& device, const Protocol::Frame& cmd, Callback done, const bool force, const Protocol::Priority priority)
+{
+	std::vector<Job> jobs;
+	jobs.push_back({&device, cmd, std::move(done), HCS::Deadline::current(), force, priority});
+	enqueue(jobs);
+}
+
+void HCSManager::wake()
+{
+	uint64_t one = 1;
+	if(write(wakeFd, &one, sizeof(one)) < 0)
+	{
+		std::string msg = std::string(strerror(errno));
+		throw std::runtime_error("could not wake up I/O thread: " + msg);
+	}
+}
+
+std::future<std::string> HCSManager::post(HCS& device, const Protocol::Frame& cmd)
+{
+	return std::move(post({{&device, cmd, ""}}).front());
+}
+
+/**
+ * Passes several commands to the I/O thread at once, so the commands of one
+ * device are written with a single write().
+ */
+std::vector<std::future<std::string>> HCSManager::post(const std::vector<Request>& requests)
+{
+	std::vector<std::future<std::string>> responses;
+	std::vector<Job> jobs;
+	const auto expires = HCS::Deadline::current();
+
+	for(auto& r : requests)
+	{
+		auto result = std::make_shared<std::promise<std::string>>();
+		responses.push_back(result->get_future());
+		jobs.push_back({r.device, r.cmd, [result](const std::string& response, std::exception_ptr error){
+			if(error){
+				result->set_exception(error);
+			}else{
+				result->set_value(response);
+			}
+		}, expires, r.force, Protocol::priority(r.cmd.command)});
+	}
+
+	enqueue(jobs);
+	return responses;
+}
+
+/**
+ * Queues jobs on their devices. All of them are queued at once, when there is space for all.
+ * Until then the posting thread blocks, if its deadline expires, nothing is queued.
+ * The I/O thread can not wait for itself, it fails immediately.
+ */
+void HCSManager::enqueue(std::vector<Job>& jobs)
+{
+	std::vector<size_t> index;
+	for(const Job& job : jobs)
+	{
+		auto d = std::find_if(devices.begin(), devices.end(), [&job](const std::unique_ptr<HCS>& d){ return d.get() == job.device; });
+		if(d == devices.end()){
+			throw std::runtime_error("device of command <" + std::string(job.cmd.text()) + "> is not owned by this HCSManager");
+		}
+		index.push_back(d - devices.begin());
+	}
+
+	auto fits = [this, &jobs, &index]() {
+		for(size_t i = 0; i < jobs.size(); ++i)
+		{
+			const size_t p = static_cast<size_t>(jobs[i].priority);
+			const size_t same = std::count_if(jobs.begin(), jobs.begin() + i + 1, [&](const Job& j){ return j.device == jobs[i].device && j.priority == jobs[i].priority; });
+			if(queues[index[i]].waiting[p].size() + same > options.queueDepth){
+				return false;
+			}
+		}
+		return true;
+	};
+
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		const std::string what = (jobs.size() == 1) ? "command <" + std::string(jobs.front().cmd.text()) + ">" : std::to_string(jobs.size()) + " commands";
+
+		for(const Job& job : jobs)
+		{
+			if(job.priority == Protocol::Priority::SETPOINT && std::find(inhibited.begin(), inhibited.end(), job.device) != inhibited.end()){
+				throw std::runtime_error("can not send " + what + ". Setpoints of <" + job.device->uart + "> are inhibited, until the protection is rearmed");
+			}
+		}
+
+		if(running && !fits())
+		{
+			const auto expires = jobs.empty() ? std::chrono::steady_clock::time_point::max() : jobs.front().expires;
+			if(std::this_thread::get_id() == ioThread.get_id()){
+				throw std::runtime_error("can not queue " + what + ". The queue of the device is full");
+			}
+			if(expires == std::chrono::steady_clock::time_point::max()){
+				space.wait(lock, [this, &fits]{ return !running || fits(); });
+			}else if(!space.wait_until(lock, expires, [this, &fits]{ return !running || fits(); })){
+				throw std::runtime_error("can not queue " + what + ". The queue of the device is full until the deadline");
+			}
+		}
+		if(!running){
+			throw std::runtime_error("can not send " + what + ". The I/O thread is not running, see HCSManager::start()");
+		}
+
+		for(size_t i = 0; i < jobs.size(); ++i){
+			queues[index[i]].waiting[static_cast<size_t>(jobs[i].priority)].push_back(std::move(jobs[i]));
+		}
+	}
+	wake();
+}
+
+void HCSManager::inhibit(HCS& device)
+{
+	std::deque<Job> dropped;
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		if(std::find(inhibited.begin(), inhibited.end(), &device) == inhibited.end()){
+			inhibited.push_back(&device);
+		}
+		auto d = std::find_if(devices.begin(), devices.end(), [&device](const std::unique_ptr<HCS>& d){ return d.get() == &device; });
+		const size_t i = d - devices.begin();
+		if(i < queues.size()){
+			dropped.swap(queues[i].waiting[static_cast<size_t>(Protocol::Priority::SETPOINT)]);
+		}
+	}
+	space.notify_all();
+
+	std::exception_ptr error = std::make_exception_ptr(std::runtime_error("setpoint was dropped, because the protection of <" + device.uart + "> tripped"));
+	for(Job& job : dropped){
+		job.done("", error);
+	}
+}
+
+void HCSManager::release(HCS& device)
+{
+	std::lock_guard<std::mutex> lock(queueMutex);
+	inhibited.erase(std::remove(inhibited.begin(), inhibited.end(), &device), inhibited.end());
+}
+
+void HCSManager::defer(std::function<void()> f)
+{
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		if(!running){
+			throw std::runtime_error("can not defer a function. The I/O thread is not running, see HCSManager::start()");
+		}
+		deferred.push_back(std::move(f));
+	}
+	// the I/O thread runs it, after it was woken up by the commands in progress
+	if(std::this_thread::get_id() != ioThread.get_id()){
+		wake();
+	}
+}
+
+void HCSManager::runDeferred()
+{
+	std::vector<std::function<void()>> functions;
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		functions.swap(deferred);
+	}
+	for(auto& f : functions){
+		f();
+	}
+}
+
+/**
+ * Moves waiting commands of device i to its connection, the highest priority class first,
+ * until pipelineDepth commands are in flight.
+ * returns true, if a command was moved
+ */
+bool HCSManager::admit(Channel& channel, const size_t i)
+{
+	bool admitted = false;
+	while(channel.device->transactions.size() < options.pipelineDepth)
+	{
+		Job job;
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			auto q = std::find_if(std::begin(queues[i].waiting), std::end(queues[i].waiting), [](const std::deque<Job>& q){ return !q.empty(); });
+			if(q == std::end(queues[i].waiting)){
+				break;
+			}
+			job = std::move(q->front());
+			q->pop_front();
+		}
+		space.notify_all();
+		dispatch(channel, job);
+		admitted = true;
+	}
+	return admitted;
+}
+
+/**
+ * Queues the command of a job on its device. Commands of one device are pipelined,
+ * their responses are matched in the order they were sent.
+ * A setpoint, that the device already has, is finished without sending it.
+ */
+void HCSManager::dispatch(Channel& channel, Job& job)
+{
+	try{
+		channel.device->isConnected();
+		if(!job.force && channel.device->elide(job.cmd)){
+			job.done("", nullptr);
+			return;
+		}
+		channel.device->submit(job.cmd, job.expires);
+		channel.pending.push_back(std::move(job.done));
+	}catch (...) {
+		job.done("", std::current_exception());
+	}
+}
+
+/**
+ * Fails all commands in progress on the device of channel
+ */
+void HCSManager::fail(Channel& channel, std::exception_ptr error)
+{
+	channel.device->abort();
+	while(!channel.pending.empty())
+	{
+		Callback done = std::move(channel.pending.front());
+		channel.pending.pop_front();
+		done("", error);
+	}
+}
+
+/**
+ * Finishes all transactions of a device, whose responses are received.
+ */
+void HCSManager::service(Channel& channel, bool readable)
+{
+	HCS& d = *channel.device;
+
+	try{
+		d.transmit();
+
+		while(!d.transactions.empty() && d.service(readable))
+		{
+			readable = false;
+			Callback done = std::move(channel.pending.front());
+			channel.pending.pop_front();
+
+			std::string response;
+			std::exception_ptr error;
+			try{
+				response = d.finish();
+			}catch (...) {
+				error = std::current_exception();
+			}
+			done(response, error);
+
+			// a failed command drops the commands sent after it
+			if(error && !channel.pending.empty()){
+				fail(channel, std::make_exception_ptr(std::runtime_error("command was dropped, because a previous command failed")));
+			}
+		}
+	}catch (...) {
+		fail(channel, std::current_exception());
+	}
+}
+
+void HCSManager::ioLoop()
+{
+	std::vector<Channel> channels;
+	for(auto& d : devices){
+		channels.push_back({d.get(), {}});
+	}
+
+	std::vector<struct pollfd> fds(channels.size() + 1);
+
+	while(running)
+	{
+		runDeferred();
+
+		auto next = std::chrono::steady_clock::time_point::max();
+		fds[0] = {wakeFd, POLLIN, 0};
+
+		for(size_t i = 0; i < channels.size(); ++i)
+		{
+			HCS& d = *channels[i].device;
+			fds[i + 1] = {-1, POLLIN, 0};
+
+			// new commands are written with one write(). Responses, that are buffered already, finish
+			// transactions without poll(), their slots are filled again before the loop sleeps
+			admit(channels[i], i);
+			service(channels[i], false);
+			while(d.transactions.size() < options.pipelineDepth && admit(channels[i], i)){
+				service(channels[i], false);
+			}
+			if(d.transactions.empty()){
+				continue;
+			}
+
+			const HCS::Transaction& t = d.transactions.front();
+			fds[i + 1].fd = d.receiving() ? d.transport->descriptor() : -1;
+			next = std::min(next, t.deadline);
+		}
+
+		auto timeout = -1;
+		if(next != std::chrono::steady_clock::time_point::max()){
+			auto remaining = std::chrono::ceil<std::chrono::milliseconds>(next - std::chrono::steady_clock::now()).count();
+			timeout = std::max<int>(remaining, 0);
+		}
+
+		if(poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR)
+		{
+			std::string msg = std::string(strerror(errno));
+			std::exception_ptr error = std::make_exception_ptr(std::runtime_error("poll failed for usart: " + msg));
+			for(auto& c : channels){
+				fail(c, error);
+			}
+			continue;
+		}
+
+		if(fds[0].revents & POLLIN)
+		{
+			uint64_t wakeups;
+			if(read(wakeFd, &wakeups, sizeof(wakeups)) < 0){
+				// eventfd is non blocking, there is nothing to read
+			}
+		}
+
+		for(size_t i = 0; i < channels.size(); ++i)
+		{
+			if(!channels[i].device->transactions.empty()){
+				service(channels[i], fds[i + 1].revents & (POLLIN | POLLERR | POLLHUP));
+			}
+		}
+	}
+
+	// fail all commands, that are left
+	std::exception_ptr stopped = std::make_exception_ptr(std::runtime_error("I/O thread of HCSManager was stopped"));
+	std::vector<Job> jobs;
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		for(auto& q : queues)
+		{
+			for(auto& waiting : q.waiting){
+				std::move(waiting.begin(), waiting.end(), std::back_inserter(jobs));
+				waiting.clear();
+			}
+		}
+	}
+	for(auto& job : jobs){
+		job.done("", stopped);
+	}
+	for(auto& c : channels){
+		fail(c, stopped);
+	}
+	runDeferred();
+}
+
+/**
+ * Processes all requests in one event loop. The requests of one device are sent
+ * one after another, all devices are serviced concurrently.
+ * If a device fails, the remaining devices are finished before the error is thrown.
+ */
+void HCSManager::transact(std::vector<Request>& requests)
+{
+	if(isRunning())
+	{
+		// the I/O thread owns the connections
+		std::vector<std::future<std::string>> responses = post(requests);
+
+		std::exception_ptr error;
+		for(size_t i = 0; i < requests.size(); ++i)
+		{
+			try{
+				requests[i].response = responses[i].get();
+			}catch (...) {
+				if(!error){
+					error = std::current_exception();
+				}
+			}
+		}
+		if(error){
+			std::rethrow_exception(error);
+		}
+		return;
+	}
+
+	struct Queue {
+		HCS *device;
+		std::deque<Request*> pending;
+	};
+	std::vector<Queue> queues;
+	std::exception_ptr error;
+
+	// the devices are locked in the order of their addresses, so concurrent calls can not deadlock
+	std::vector<HCS*> involved;
+	for(auto& r : requests){
+		involved.push_back(r.device);
+	}
+	std::sort(involved.begin(), involved.end());
+	involved.erase(std::unique(involved.begin(), involved.end()), involved.end());
+	std::vector<std::unique_lock<std::mutex>> locks;
+	for(HCS *d : involved){
+		locks.emplace_back(d->connectionMutex);
+	}
+
+	for(auto& r : requests)
+	{
+		auto q = std::find_if(queues.begin(), queues.end(), [&r](const Queue& q){ return q.device == r.device; });
+		if(q == queues.end()){
+			queues.push_back({r.device, {}});
+			q = queues.end() - 1;
+		}
+		q->pending.push_back(&r);
+	}
+
+	// starts the next request of a device. returns false if there is none
+	auto beginNext = [&error](Queue& q) {
+		while(!q.pending.empty())
+		{
+			Request *r = q.pending.front();
+			try{
+				if(!r->force && q.device->elide(r->cmd)){
+					q.pending.pop_front();
+					continue;
+				}
+				q.device->begin(r->cmd);
+				return true;
+			}catch (...) {
+				if(!error){
+					error = std::current_exception();
+				}
+				q.pending.clear();
+			}
+		}
+		return false;
+	};
+
+	queues.erase(std::remove_if(queues.begin(), queues.end(), [&beginNext](Queue& q){ return !beginNext(q); }), queues.end());
+
+	std::vector<struct pollfd> fds;
+	while(!queues.empty())
+	{
+		auto next = std::chrono::steady_clock::time_point::max();
+		fds.resize(queues.size());
+
+		for(size_t i = 0; i < queues.size(); ++i)
+		{
+			const HCS::Transaction& t = queues[i].device->transactions.front();
+			// a device waiting to resend is only interested in the stale responses, see HCS::receiving()
+			fds[i] = {queues[i].device->receiving() ? queues[i].device->transport->descriptor() : -1, POLLIN, 0};
+			next = std::min(next, t.deadline);
+		}
+
+		auto timeout = std::chrono::ceil<std::chrono::milliseconds>(next - std::chrono::steady_clock::now()).count();
+		if(poll(fds.data(), fds.size(), std::max<int>(timeout, 0)) < 0 && errno != EINTR)
+		{
+			std::string msg = std::string(strerror(errno));
+			throw std::runtime_error("poll failed for usart: " + msg);
+		}
+
+		for(size_t i = 0; i < queues.size(); ++i)
+		{
+			Queue& q = queues[i];
+			try{
+				if(!q.device->service(fds[i].revents & (POLLIN | POLLERR | POLLHUP))){
+					continue;
+				}
+				q.pending.front()->response = q.device->finish();
+				q.pending.pop_front();
+			}catch (...) {
+				if(!error){
+					error = std::current_exception();
+				}
+				q.pending.clear();
+			}
+			beginNext(q);
+		}
+
+		queues.erase(std::remove_if(queues.begin(), queues.end(), [](const Queue& q){ return q.pending.empty(); }), queues.end());
+	}
+
+	if(error){
+		std::rethrow_exception(error);
+	}
+}
+
+void HCSManager::setVoltage(const std::vector<float>& voltages)
+{
+	if(voltages.size() != devices.size()){
+		throw std::runtime_error("expected <" + std::to_string(devices.size()) + "> voltages, but got <" + std::to_string(voltages.size()) + ">");
+	}
+
+	// all values are validated, before anything is sent
+	std::vector<Request> requests;
+	for(size_t i = 0; i < devices.size(); ++i){
+		requests.push_back({devices[i].get(), devices[i]->voltageCommand(voltages[i]), ""});
+	}
+	transact(requests);
+}
+
+void HCSManager::setCurrent(const std::vector<float>& currents)
+{
+	if(currents.size() != devices.size()){
+		throw std::runtime_error("expected <" + std::to_string(devices.size()) + "> currents, but got <" + std::to_string(currents.size()) + ">");
+	}
+
+	std::vector<Request> requests;
+	for(size_t i = 0; i < devices.size(); ++i){
+		requests.push_back({devices[i].get(), devices[i]->currentCommand(currents[i]), ""});
+	}
+	transact(requests);
+}
+
+std::vector<std::string> HCSManager::getPresentVoltageAndCurrent()
+{
+	std::vector<Request> requests;
+	for(auto& d : devices){
+		requests.push_back({d.get(), Protocol::encode<Protocol::Command::GETS>(), ""});
+	}
+	transact(requests);
+
+	std::vector<std::string> voltCurr;
+	for(auto& r : requests){
+		voltCurr.push_back(std::move(r.response));
+	}
+	return voltCurr;
+}
@@ -0,0 +1,155 @@
+/*
+ * HCSManager.h
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#ifndef HCSMANAGER_H_
+#define HCSMANAGER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "HCS.h"
+
+/**
+ * Owns several HCS devices and services all of them from one event loop.
+ * A command is sent to every device before any response is awaited, so a
+ * command on N supplies takes about as long as on the slowest of them.
+ *
+ * After start(), the event loop runs on an I/O thread, which owns the
+ * connections of all devices. It processes the asynchronous commands of the
+ * devices (HCS::setVoltageAsync(), ...), blocking calls are passed to it,
+ * so any thread may use the devices. Only the I/O thread itself (e.g. a callback
+ * of post()) can not make blocking calls, they throw.
+ *
+ * Commands wait in a bounded queue per device and priority class (see Protocol::Priority),
+ * up to pipelineDepth of them are in flight per device. A waiting limit is sent before
+ * a waiting setpoint, a setpoint before a read. If a queue is full, the posting thread
+ * blocks until there is space or its HCS::Deadline expires.
+ */
+class HCSManager {
+	friend class HCS;
+	friend class HCS::Batch;
+	friend class HCSSampler;
+	friend class HCSGroup;
+	friend class HCSGateway;
+	friend class HCSProtection;
+public:
+	// called on the I/O thread with the response or the error of a command
+	using Callback = std::function<void(const std::string& response, std::exception_ptr error)>;
+
+	struct Options {
+		unsigned int pipelineDepth = 4;		// commands in flight per device
+		size_t queueDepth = 64;				// waiting commands per device and priority class
+	};
+
+private:
+	std::vector<std::unique_ptr<HCS>> devices;
+	Options options;
+
+	struct Job {
+		HCS *device;
+		Protocol::Frame cmd;
+		Callback done;
+		std::chrono::steady_clock::time_point expires;	// deadline of the posting thread, see HCS::Deadline
+		bool force;		// sent, even if the device already has the value, see HCS::elide()
+		Protocol::Priority priority;
+	};
+
+	// waiting commands of one device, one queue per priority class
+	struct Queue {
+		std::deque<Job> waiting[Protocol::PRIORITIES];
+	};
+
+	// callbacks of the commands in progress on one device, in the order they were sent
+	struct Channel {
+		HCS *device;
+		std::deque<Callback> pending;
+	};
+
+	std::thread ioThread;
+	std::atomic<bool> running{false};
+	std::mutex queueMutex;
+	std::condition_variable space;		// a queue has space again
+	std::vector<Queue> queues;			// one per device, guarded by queueMutex
+	std::vector<HCS*> inhibited;		// devices, that reject setpoints, guarded by queueMutex
+	std::vector<std::function<void()>> deferred;	// run by the next turn of the event loop, guarded by queueMutex
+	int wakeFd = -1;
+
+	void ioLoop();
+	void wake();
+	void enqueue(std::vector<Job>& jobs);
+	bool admit(Channel& channel, const size_t i);
+	void dispatch(Channel& channel, Job& job);
+	void service(Channel& channel, bool readable);
+	void fail(Channel& channel, std::exception_ptr error);
+	void runDeferred();
+
+	bool isRunning() const;
+	void post(HCS& device, const Protocol::Frame& cmd, Callback done, const bool force = false);
+	// overrides the priority class of the command, e.g. a VOLT000 of HCSProtection is sent before any setpoint
+	void post(HCS& device, const Protocol::Frame& cmd, Callback done, const bool force, const Protocol::Priority priority);
+	std::future<std::string> post(HCS& device, const Protocol::Frame& cmd);
+
+	struct Request {
+		HCS *device;
+		Protocol::Frame cmd;
+		std::string response;
+		bool force = false;
+	};
+
+	std::vector<std::future<std::string>> post(const std::vector<Request>& requests);
+
+	void transact(std::vector<Request>& requests);
+
+	// fails the waiting setpoints (Protocol::Priority::SETPOINT) of device and rejects new ones
+	// until release(), see HCSProtection. Commands in progress are not recalled
+	void inhibit(HCS& device);
+	void release(HCS& device);
+
+	// runs f on the I/O thread with the next turn of the event loop, e.g. to retry a command,
+	// that could not be queued. It is run once more, when the I/O thread stops
+	void defer(std::function<void()> f);
+
+	HCSManager(const HCSManager &other) = delete;
+	HCSManager(HCSManager &&other) = delete;
+	HCSManager& operator=(const HCSManager &other) = delete;
+	HCSManager& operator=(HCSManager &&other) = delete;
+
+public:
+	HCSManager() = default;
+	explicit HCSManager(Options _options) : options(_options) {}
+	virtual ~HCSManager();
+
+	HCS& add(const std::string& uart, unsigned int baud);
+	HCS& add(std::unique_ptr<Transport> transport);
+	size_t size() const;
+	HCS& operator[](size_t i);
+
+	void connect();
+	void disconnect();
+
+	// runs the event loop on an I/O thread until stop() is called
+	void start();
+	void stop();
+
+	// one value per device, in the order the devices were added
+	void setVoltage(const std::vector<float>& voltages);
+	void setCurrent(const std::vector<float>& currents);
+	std::vector<std::string> getPresentVoltageAndCurrent();
+};
+
+#endif /* HCSMANAGER_H_ */
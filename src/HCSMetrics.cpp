@@ -0,0 +1,256 @@
+/*
+ * HCSMetrics.cpp
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#include "HCSMetrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+size_t HCSMetrics::Histogram::bucketOf(const uint64_t us) noexcept
+{
+	if(us < SUB_BUCKETS){
+		return us;
+	}
+	const unsigned int msb = 63 - __builtin_clzll(us);
+	const unsigned int shift = msb - SUB_BITS;
+	const size_t bucket = (shift + 1) * SUB_BUCKETS + ((us >> shift) - SUB_BUCKETS);
+	return std::min(bucket, BUCKETS - 1);
+}
+
+uint64_t HCSMetrics::Histogram::upperBound(const size_t bucket) noexcept
+{
+	if(bucket < SUB_BUCKETS){
+		return bucket;
+	}
+	const unsigned int shift = bucket / SUB_BUCKETS - 1;
+	return ((SUB_BUCKETS + bucket % SUB_BUCKETS + 1) << shift) - 1;
+}
+
+void HCSMetrics::Histogram::record(const uint64_t us) noexcept
+{
+	buckets[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+	n.fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(us, std::memory_order_relaxed);
+
+	uint64_t m = max.load(std::memory_order_relaxed);
+	while(us > m && !max.compare_exchange_weak(m, us, std::memory_order_relaxed)){
+	}
+}
+
+void HCSMetrics::Histogram::reset() noexcept
+{
+	for(auto& b : buckets){
+		b.store(0, std::memory_order_relaxed);
+	}
+	n = 0;
+	sum = 0;
+	max = 0;
+}
+
+uint64_t HCSMetrics::Histogram::count() const noexcept
+{
+	return n;
+}
+
+double HCSMetrics::Histogram::mean() const noexcept
+{
+	const uint64_t c = n;
+	return (c > 0) ? static_cast<double>(sum) / c : 0.0;
+}
+
+uint64_t HCSMetrics::Histogram::maximum() const noexcept
+{
+	return max;
+}
+
+uint64_t HCSMetrics::Histogram::percentile(const double p) const noexcept
+{
+	const uint64_t c = n;
+	if(c == 0){
+		return 0;
+	}
+
+	const uint64_t rank = std::max<uint64_t>(1, std::ceil(c * std::min(p, 100.0) / 100.0));
+	uint64_t seen = 0;
+	for(size_t b = 0; b < BUCKETS; ++b)
+	{
+		seen += buckets[b].load(std::memory_order_relaxed);
+		if(seen >= rank){
+			return std::min(upperBound(b), maximum());
+		}
+	}
+	return maximum();
+}
+
+void HCSMetrics::recordSent(const Protocol::Command c, const uint64_t sendUs) noexcept
+{
+	at(c).sent.fetch_add(1, std::memory_order_relaxed);
+	at(c).stages[static_cast<size_t>(Stage::SEND)].record(sendUs);
+}
+
+void HCSMetrics::recordCompleted(const Protocol::Command c, const uint64_t firstByteUs, const uint64_t completeUs) noexcept
+{
+	at(c).completed.fetch_add(1, std::memory_order_relaxed);
+	at(c).stages[static_cast<size_t>(Stage::FIRST_BYTE)].record(firstByteUs);
+	at(c).stages[static_cast<size_t>(Stage::COMPLETE)].record(completeUs);
+}
+
+void HCSMetrics::recordFailed(const Protocol::Command c) noexcept
+{
+	at(c).failed.fetch_add(1, std::memory_order_relaxed);
+}
+
+void HCSMetrics::recordRetry(const Protocol::Command c) noexcept
+{
+	at(c).retries.fetch_add(1, std::memory_order_relaxed);
+}
+
+void HCSMetrics::recordTimeout(const Protocol::Command c) noexcept
+{
+	at(c).timeouts.fetch_add(1, std::memory_order_relaxed);
+}
+
+void HCSMetrics::recordMalformed(const Protocol::Command c) noexcept
+{
+	at(c).malformed.fetch_add(1, std::memory_order_relaxed);
+}
+
+void HCSMetrics::recordElided(const Protocol::Command c) noexcept
+{
+	at(c).elided.fetch_add(1, std::memory_order_relaxed);
+}
+
+void HCSMetrics::recordWritten(const uint64_t bytes) noexcept
+{
+	written.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void HCSMetrics::recordReceived(const uint64_t bytes) noexcept
+{
+	received.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void HCSMetrics::recordFlush(const uint64_t bytes) noexcept
+{
+	flushes.fetch_add(1, std::memory_order_relaxed);
+	flushed.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void HCSMetrics::recordResync(const uint64_t bytes) noexcept
+{
+	resyncs.fetch_add(1, std::memory_order_relaxed);
+	flushed.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void HCSMetrics::recordDiscarded(const uint64_t bytes) noexcept
+{
+	flushed.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void HCSMetrics::reset() noexcept
+{
+	for(auto& c : commands)
+	{
+		c.sent = 0;
+		c.completed = 0;
+		c.failed = 0;
+		c.retries = 0;
+		c.timeouts = 0;
+		c.malformed = 0;
+		c.elided = 0;
+		for(auto& h : c.stages){
+			h.reset();
+		}
+	}
+	written = 0;
+	received = 0;
+	flushes = 0;
+	resyncs = 0;
+	flushed = 0;
+}
+
+std::string HCSMetrics::toText() const
+{
+	char line[256];
+	std::string out;
+
+	snprintf(line, sizeof(line), "%-6s %10s %10s %8s %8s %8s %9s %8s %16s %16s %24s\n",
+			"cmd", "sent", "completed", "failed", "retries", "timeouts", "malformed", "elided",
+			"send[us]", "first byte[us]", "complete[us]");
+	out += line;
+	snprintf(line, sizeof(line), "%-6s %10s %10s %8s %8s %8s %9s %8s %16s %16s %24s\n",
+			"", "", "", "", "", "", "", "", "p50/p99", "p50/p99", "p50/p99/max");
+	out += line;
+
+	for(size_t i = 0; i < COMMANDS; ++i)
+	{
+		const Command& c = commands[i];
+		if(c.sent == 0 && c.elided == 0){
+			continue;
+		}
+
+		char send[32], first[32], complete[48];
+		snprintf(send, sizeof(send), "%llu/%llu",
+				(unsigned long long)c.latency(Stage::SEND).percentile(50), (unsigned long long)c.latency(Stage::SEND).percentile(99));
+		snprintf(first, sizeof(first), "%llu/%llu",
+				(unsigned long long)c.latency(Stage::FIRST_BYTE).percentile(50), (unsigned long long)c.latency(Stage::FIRST_BYTE).percentile(99));
+		snprintf(complete, sizeof(complete), "%llu/%llu/%llu",
+				(unsigned long long)c.latency(Stage::COMPLETE).percentile(50), (unsigned long long)c.latency(Stage::COMPLETE).percentile(99),
+				(unsigned long long)c.latency(Stage::COMPLETE).maximum());
+
+		snprintf(line, sizeof(line), "%-6s %10llu %10llu %8llu %8llu %8llu %9llu %8llu %16s %16s %24s\n",
+				Protocol::COMMANDS[i].mnemonic, (unsigned long long)c.sent, (unsigned long long)c.completed,
+				(unsigned long long)c.failed, (unsigned long long)c.retries, (unsigned long long)c.timeouts,
+				(unsigned long long)c.malformed, (unsigned long long)c.elided, send, first, complete);
+		out += line;
+	}
+
+	snprintf(line, sizeof(line), "bytes written <%llu> received <%llu>, flushes <%llu> resyncs <%llu> discarded <%llu> bytes\n",
+			(unsigned long long)bytesWritten(), (unsigned long long)bytesReceived(),
+			(unsigned long long)flushCount(), (unsigned long long)resyncCount(), (unsigned long long)bytesFlushed());
+	out += line;
+	return out;
+}
+
+std::string HCSMetrics::toJson() const
+{
+	static const char *STAGE_NAMES[STAGES] = {"send", "first_byte", "complete"};
+	char buf[256];
+	std::string out;
+
+	snprintf(buf, sizeof(buf), "{\"bytes_written\":%llu,\"bytes_received\":%llu,\"flushes\":%llu,\"resyncs\":%llu,\"bytes_flushed\":%llu,\"commands\":{",
+			(unsigned long long)bytesWritten(), (unsigned long long)bytesReceived(),
+			(unsigned long long)flushCount(), (unsigned long long)resyncCount(), (unsigned long long)bytesFlushed());
+	out += buf;
+
+	for(size_t i = 0; i < COMMANDS; ++i)
+	{
+		const Command& c = commands[i];
+		snprintf(buf, sizeof(buf), "%s\"%s\":{\"sent\":%llu,\"completed\":%llu,\"failed\":%llu,\"retries\":%llu,\"timeouts\":%llu,\"malformed\":%llu,\"elided\":%llu",
+				(i > 0) ? "," : "", Protocol::COMMANDS[i].mnemonic,
+				(unsigned long long)c.sent, (unsigned long long)c.completed, (unsigned long long)c.failed,
+				(unsigned long long)c.retries, (unsigned long long)c.timeouts, (unsigned long long)c.malformed,
+				(unsigned long long)c.elided);
+		out += buf;
+
+		for(size_t s = 0; s < STAGES; ++s)
+		{
+			const Histogram& h = c.stages[s];
+			snprintf(buf, sizeof(buf), ",\"%s_us\":{\"count\":%llu,\"mean\":%.1f,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"max\":%llu}",
+					STAGE_NAMES[s], (unsigned long long)h.count(), h.mean(),
+					(unsigned long long)h.percentile(50), (unsigned long long)h.percentile(90),
+					(unsigned long long)h.percentile(99), (unsigned long long)h.maximum());
+			out += buf;
+		}
+		out += "}";
+	}
+
+	out += "}}";
+	return out;
+}
@@ -0,0 +1,149 @@
+/*
+ * HCSMetrics.h
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#ifndef HCSMETRICS_H_
+#define HCSMETRICS_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Protocol.h"
+
+/**
+ * Counters and latency histograms of one device connection.
+ *
+ * They are updated by the thread, that drives the connection, and can be read
+ * from any other thread at any time. Recording does not allocate or lock.
+ *
+ *	const HCSMetrics& m = h.metrics();
+ *	auto& gets = m.command(Protocol::Command::GETS);
+ *	uint64_t p99 = gets.latency(HCSMetrics::Stage::COMPLETE).percentile(99.0);
+ *	std::cout << m.toText();
+ */
+class HCSMetrics {
+public:
+	/**
+	 * SEND:		the command is queued, until it is written to the device
+	 * FIRST_BYTE:	the command is written, until the first byte of its response is received
+	 * COMPLETE:	the command is queued, until its response is complete, including all retries
+	 */
+	enum class Stage : uint8_t {SEND, FIRST_BYTE, COMPLETE};
+	static constexpr size_t STAGES = 3;
+	static constexpr size_t COMMANDS = sizeof(Protocol::COMMANDS) / sizeof(Protocol::COMMANDS[0]);
+
+	/**
+	 * Log-linear histogram of latencies in us. Values below SUB_BUCKETS are exact,
+	 * above each power of two is split into SUB_BUCKETS buckets (12.5% wide).
+	 * Values above about 16s are counted in the last bucket.
+	 */
+	class Histogram {
+	public:
+		static constexpr unsigned int SUB_BITS = 3;
+		static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BITS;
+		static constexpr size_t BUCKETS = 22 * SUB_BUCKETS;
+
+	private:
+		std::atomic<uint32_t> buckets[BUCKETS] = {};
+		std::atomic<uint64_t> n{0};
+		std::atomic<uint64_t> sum{0};
+		std::atomic<uint64_t> max{0};
+
+		static size_t bucketOf(const uint64_t us) noexcept;
+		static uint64_t upperBound(const size_t bucket) noexcept;
+
+	public:
+		void record(const uint64_t us) noexcept;
+		void reset() noexcept;
+
+		uint64_t count() const noexcept;
+		double mean() const noexcept;
+		uint64_t maximum() const noexcept;
+		// the upper bound of the bucket, that contains the p-th percentile, 0 if empty
+		uint64_t percentile(const double p) const noexcept;
+	};
+
+	struct Command {
+		std::atomic<uint64_t> sent{0};		// commands written, without resends
+		std::atomic<uint64_t> completed{0};	// valid responses
+		std::atomic<uint64_t> failed{0};	// all tries failed
+		std::atomic<uint64_t> retries{0};	// resends
+		std::atomic<uint64_t> timeouts{0};	// the response was incomplete at the deadline
+		std::atomic<uint64_t> malformed{0};	// the response did not match the expected frame
+		std::atomic<uint64_t> elided{0};	// not sent, the device already has the value, see HCS
+		Histogram stages[STAGES];
+
+		const Histogram& latency(const Stage stage) const {
+			return stages[static_cast<size_t>(stage)];
+		}
+	};
+
+private:
+	Command commands[COMMANDS];
+	std::atomic<uint64_t> written{0};	// bytes written to the device
+	std::atomic<uint64_t> received{0};	// bytes read from the device
+	std::atomic<uint64_t> flushes{0};
+	std::atomic<uint64_t> resyncs{0};	// framing errors, see SerialReader::resync()
+	std::atomic<uint64_t> flushed{0};	// bytes discarded by flushes and resyncs
+
+	Command& at(const Protocol::Command c) {
+		return commands[static_cast<size_t>(c)];
+	}
+
+	HCSMetrics(const HCSMetrics &other) = delete;
+	HCSMetrics(HCSMetrics &&other) = delete;
+	HCSMetrics& operator=(const HCSMetrics &other) = delete;
+	HCSMetrics& operator=(HCSMetrics &&other) = delete;
+
+public:
+	HCSMetrics() = default;
+	virtual ~HCSMetrics() = default;
+
+	// recording, called by HCS
+	void recordSent(const Protocol::Command c, const uint64_t sendUs) noexcept;
+	void recordCompleted(const Protocol::Command c, const uint64_t firstByteUs, const uint64_t completeUs) noexcept;
+	void recordFailed(const Protocol::Command c) noexcept;
+	void recordRetry(const Protocol::Command c) noexcept;
+	void recordTimeout(const Protocol::Command c) noexcept;
+	void recordMalformed(const Protocol::Command c) noexcept;
+	void recordElided(const Protocol::Command c) noexcept;
+	void recordWritten(const uint64_t bytes) noexcept;
+	void recordReceived(const uint64_t bytes) noexcept;
+	void recordFlush(const uint64_t bytes) noexcept;
+	void recordResync(const uint64_t bytes) noexcept;
+	void recordDiscarded(const uint64_t bytes) noexcept;
+
+	void reset() noexcept;
+
+	const Command& command(const Protocol::Command c) const {
+		return commands[static_cast<size_t>(c)];
+	}
+	uint64_t bytesWritten() const noexcept {
+		return written;
+	}
+	uint64_t bytesReceived() const noexcept {
+		return received;
+	}
+	uint64_t flushCount() const noexcept {
+		return flushes;
+	}
+	uint64_t resyncCount() const noexcept {
+		return resyncs;
+	}
+	uint64_t bytesFlushed() const noexcept {
+		return flushed;
+	}
+
+	// one line per used command and the byte counters
+	std::string toText() const;
+	// all commands, latencies in us
+	std::string toJson() const;
+};
+
+#endif /* HCSMETRICS_H_ */
@@ -0,0 +1,249 @@
+/*
+ * HCSProtection.cpp
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#include "HCSProtection.h"
+#include "HCSManager.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+static int64_t now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const char* toString(const HCSProtection::Reason reason)
+{
+	static const char *REASON[] = {"voltage", "current", "power"};
+	return REASON[static_cast<size_t>(reason)];
+}
+
+// only the displayed values are checked, GETS returns the presets.
+// The samples are not delayed by waiting setpoints, so the sample period stays bounded
+static HCSSampler::Options displayOnly(std::function<void(const HCSSample&)> observer)
+{
+	HCSSampler::Options o;
+	o.readDisplay = true;
+	o.readSetpoint = false;
+	o.priority = Protocol::Priority::SAFETY;
+	o.observer = std::move(observer);
+	return o;
+}
+
+HCSProtection::HCSProtection(HCS& _hcs, Options _options) : hcs(_hcs), options(_options),
+		sampler(_hcs, displayOnly([this](const HCSSample& sample){ check(sample); }))
+{
+}
+
+// a device can not be rearmed without its protection, it is released
+HCSProtection::~HCSProtection()
+{
+	stop();
+	if(tripped && hcs.manager){
+		hcs.manager->release(hcs);
+	}
+}
+
+void HCSProtection::start()
+{
+	if(sampler.isRunning()){
+		return;
+	}
+	if(hcs.manager && hcs.manager->options.pipelineDepth < 2){
+		throw std::runtime_error("protection of <" + hcs.uart + "> needs a pipelineDepth of 2 at least, the samples would hold back all other commands");
+	}
+	exceededSince = 0;
+	previous = 0;
+	period = 0;
+	sampler.start();
+}
+
+void HCSProtection::stop()
+{
+	sampler.stop();
+	std::unique_lock<std::mutex> lock(idleMutex);
+	idle.wait(lock, [this]{ return inFlight == 0; });
+}
+
+bool HCSProtection::isRunning() const
+{
+	return sampler.isRunning();
+}
+
+/**
+ * Checks a sample on the I/O thread. It trips, when a threshold is exceeded by all samples of the hold-off time.
+ */
+void HCSProtection::check(const HCSSample& sample)
+{
+	if(previous > 0 && sample.timestamp - previous > period){
+		period = sample.timestamp - previous;
+	}
+	previous = sample.timestamp;
+
+	Reason reason;
+	float value, threshold;
+	if(tripped || !exceeds(sample, reason, value, threshold))
+	{
+		exceededSince = 0;
+		return;
+	}
+
+	if(exceededSince == 0){
+		exceededSince = sample.timestamp;
+	}
+	if(sample.timestamp - exceededSince >= std::chrono::duration_cast<std::chrono::nanoseconds>(options.holdoff).count()){
+		trip(reason, value, threshold, sample);
+	}
+}
+
+bool HCSProtection::exceeds(const HCSSample& sample, Reason& reason, float& value, float& threshold) const
+{
+	const float power = sample.voltage * sample.current;
+
+	if(options.maxVoltage > 0.0f && sample.voltage > options.maxVoltage){
+		reason = Reason::VOLTAGE;
+		value = sample.voltage;
+		threshold = options.maxVoltage;
+	}else if(options.maxCurrent > 0.0f && sample.current > options.maxCurrent){
+		reason = Reason::CURRENT;
+		value = sample.current;
+		threshold = options.maxCurrent;
+	}else if(options.maxPower > 0.0f && power > options.maxPower){
+		reason = Reason::POWER;
+		value = power;
+		threshold = options.maxPower;
+	}else{
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Queues the safe command before every waiting command of the device. It is always sent,
+ * even if the device seems to have the value already (see HCS::elide()). The waiting
+ * setpoints of the device fail and new ones are rejected, until rearm().
+ */
+void HCSProtection::trip(const Reason reason, const float value, const float threshold, const HCSSample& sample)
+{
+	tripped = true;
+	hcs.manager->inhibit(hcs);
+
+	size_t i;
+	{
+		std::lock_guard<std::mutex> lock(tripMutex);
+		history.push_back({reason, value, threshold, exceededSince, sample.timestamp, 0, false});
+		i = history.size() - 1;
+	}
+
+	const Protocol::Frame cmd = (options.action == Action::RUN_MEMORY) ? Protocol::encode<Protocol::Command::RUNM>(options.safePreset)
+			: Protocol::encode<Protocol::Command::VOLT>(0);
+
+	++inFlight;
+	try{
+		hcs.manager->post(hcs, cmd, [this, i](const std::string&, std::exception_ptr error){
+			acknowledged(i, error);
+			finished();
+		}, true, Protocol::Priority::SAFETY);
+	}catch (std::exception& e) {
+		MANSON_LOG_ERROR("protection of <" << hcs.uart << "> could not queue <" << cmd.text() << ">: " << e.what());
+		finished();
+		return;
+	}
+
+	MANSON_LOG_WARN("protection of <" << hcs.uart << "> tripped: " << toString(reason) << " <" << value << "> exceeds <" << threshold << ">, sending <" << cmd.text() << ">");
+}
+
+void HCSProtection::acknowledged(const size_t i, std::exception_ptr error)
+{
+	Trip t;
+	{
+		std::lock_guard<std::mutex> lock(tripMutex);
+		history[i].acknowledged = now();
+		history[i].ok = !error;
+		t = history[i];
+	}
+
+	if(error)
+	{
+		try{
+			std::rethrow_exception(error);
+		}catch (std::exception& e) {
+			MANSON_LOG_ERROR("protection of <" << hcs.uart << "> tripped, but the device did not acknowledge: " << e.what());
+		}
+		return;
+	}
+
+	latencies.record((t.acknowledged - t.detected) / 1000);
+	reactions.record((t.acknowledged - t.exceeded) / 1000);
+
+	const int64_t bound = reactionBound().count();
+	if(t.acknowledged - t.exceeded > bound){
+		MANSON_LOG_WARN("protection of <" << hcs.uart << "> reacted in <" << (t.acknowledged - t.exceeded) / 1000 << " us>, the bound is <" << bound / 1000 << " us>");
+	}
+}
+
+/**
+ * A safe-state command is done, the last one wakes up stop()
+ */
+void HCSProtection::finished()
+{
+	std::lock_guard<std::mutex> lock(idleMutex);
+	if(--inFlight == 0){
+		idle.notify_all();
+	}
+}
+
+bool HCSProtection::isTripped() const
+{
+	return tripped;
+}
+
+/**
+ * Accepts setpoints again. The longest sample period is measured anew, so a retry
+ * before the trip does not widen reactionBound() for good
+ */
+void HCSProtection::rearm()
+{
+	period = 0;
+	if(tripped.exchange(false) && hcs.manager){
+		hcs.manager->release(hcs);
+	}
+}
+
+std::vector<HCSProtection::Trip> HCSProtection::trips() const
+{
+	std::lock_guard<std::mutex> lock(tripMutex);
+	return history;
+}
+
+const HCSMetrics::Histogram& HCSProtection::latency() const
+{
+	return latencies;
+}
+
+const HCSMetrics::Histogram& HCSProtection::reaction() const
+{
+	return reactions;
+}
+
+std::chrono::nanoseconds HCSProtection::samplePeriod() const
+{
+	return std::chrono::nanoseconds(period);
+}
+
+/**
+ * Worst case from a threshold being exceeded until the device acknowledged the safe command, see HCSProtection
+ */
+std::chrono::nanoseconds HCSProtection::reactionBound() const
+{
+	const std::chrono::nanoseconds p = samplePeriod();
+	const std::chrono::nanoseconds holdoff = (options.holdoff.count() > 0) ? options.holdoff + p : std::chrono::nanoseconds(0);
+	const unsigned int depth = hcs.manager ? hcs.manager->options.pipelineDepth : 1;
+	return 2 * p + holdoff + (depth + 1) * p;
+}
@@ -0,0 +1,129 @@
+/*
+ * HCSProtection.h
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#ifndef HCSPROTECTION_H_
+#define HCSPROTECTION_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <vector>
+
+#include "HCS.h"
+#include "HCSMetrics.h"
+#include "HCSSampler.h"
+
+/**
+ * Software limits of a device, tighter and faster than SOVP/SOCP.
+ *
+ * The output is sampled with GETD back to back on the I/O thread of the HCSManager,
+ * every sample is checked against the voltage, current and power thresholds on that
+ * thread. If a threshold is exceeded for the hold-off time, the protection trips:
+ * VOLT000 (or RUNM of a safe preset) is queued in the SAFETY class, so it is sent
+ * before every waiting command. The waiting setpoints (VOLT, CURR, RUNM, PROM) of the
+ * device fail, new ones are rejected by the HCSManager, until rearm(). Commands, that
+ * are in progress already, are not recalled.
+ *
+ *	HCSProtection::Options o;
+ *	o.maxCurrent = 1.2f;
+ *	o.holdoff = std::chrono::milliseconds(5);
+ *	HCSProtection p(m[0], o);
+ *	p.start();
+ *	...
+ *	std::cout << "bound " << p.reactionBound().count() << "ns\n";
+ *	for(auto& t : p.trips()) { ... }
+ *
+ * The worst case reaction time is derived from the longest sample period P since start()
+ * or rearm(): a change right after a sample is seen with the next but one response (2P),
+ * the hold-off is checked on samples (holdoff + P), then the command waits for the commands
+ * in flight (HCSManager::Options::pipelineDepth), none of them takes longer than P. The
+ * bound holds as long as the sample period does not exceed P.
+ */
+class HCSProtection {
+public:
+	enum class Reason : uint8_t {VOLTAGE, CURRENT, POWER};
+	enum class Action : uint8_t {ZERO_VOLTAGE, RUN_MEMORY};
+
+	// a threshold of 0 is not checked
+	struct Options {
+		float maxVoltage = 0.0f;
+		float maxCurrent = 0.0f;
+		float maxPower = 0.0f;					// W, the product of the displayed voltage and current
+		std::chrono::microseconds holdoff{0};	// the threshold has to be exceeded that long, 0 trips on the first sample
+		Action action = Action::ZERO_VOLTAGE;
+		HCS::MEMORY safePreset = HCS::M0;		// preset of RUN_MEMORY
+	};
+
+	// timestamps are steady_clock in ns
+	struct Trip {
+		Reason reason;
+		float value;
+		float threshold;
+		int64_t exceeded;		// the first sample over the threshold was received
+		int64_t detected;		// the sample, that tripped, was received
+		int64_t acknowledged;	// the device answered the command, 0 while it is in progress
+		bool ok;
+	};
+
+private:
+	HCS& hcs;
+	Options options;
+	HCSSampler sampler;
+
+	// state of the checks, only used on the I/O thread
+	int64_t exceededSince = 0;
+	int64_t previous = 0;
+
+	std::atomic<bool> tripped{false};
+	std::atomic<int64_t> period{0};			// longest sample period since start() or rearm() in ns
+	std::atomic<unsigned int> inFlight{0};	// safe-state commands, that have not called finished() yet
+	std::mutex idleMutex;
+	std::condition_variable idle;			// notified, when inFlight drops to 0, see stop()
+	mutable std::mutex tripMutex;
+	std::vector<Trip> history;
+	HCSMetrics::Histogram latencies;		// detected until acknowledged in us
+	HCSMetrics::Histogram reactions;		// exceeded until acknowledged in us
+
+	void check(const HCSSample& sample);
+	bool exceeds(const HCSSample& sample, Reason& reason, float& value, float& threshold) const;
+	void trip(const Reason reason, const float value, const float threshold, const HCSSample& sample);
+	void acknowledged(const size_t i, std::exception_ptr error);
+	void finished();
+
+	HCSProtection(const HCSProtection &other) = delete;
+	HCSProtection(HCSProtection &&other) = delete;
+	HCSProtection& operator=(const HCSProtection &other) = delete;
+	HCSProtection& operator=(HCSProtection &&other) = delete;
+
+public:
+	HCSProtection(HCS& _hcs, Options _options);
+	virtual ~HCSProtection();
+
+	// starts sampling. The device has to be owned by a started HCSManager with a pipelineDepth of 2 at least,
+	// the samples are sent in the SAFETY class and take one of the commands in flight
+	void start();
+	// stops sampling and waits for a trip command in progress. Do not call it from the I/O thread
+	void stop();
+	bool isRunning() const;
+
+	bool isTripped() const;
+	// arms the protection again after a trip and accepts setpoints
+	void rearm();
+
+	std::vector<Trip> trips() const;
+	const HCSMetrics::Histogram& latency() const;
+	const HCSMetrics::Histogram& reaction() const;
+
+	std::chrono::nanoseconds samplePeriod() const;
+	std::chrono::nanoseconds reactionBound() const;
+};
+
+#endif /* HCSPROTECTION_H_ */
@@ -0,0 +1,180 @@
+/*
+ * HCSSampler.cpp
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#include "HCSSampler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+
+#include "HCSManager.h"
+#include "Log.h"
+
+HCSSampler::~HCSSampler()
+{
+	stop();
+}
+
+/**
+ * Starts sampling. The device has to be owned by a started HCSManager.
+ * The first commands are issued by the I/O thread, like all others.
+ */
+void HCSSampler::start()
+{
+	if(!hcs.manager || !hcs.manager->isRunning()){
+		throw std::runtime_error("can not start sampler. The device is not owned by a started HCSManager");
+	}
+	if(running.exchange(true)){
+		return;
+	}
+
+	for(unsigned int i = 0; i < std::max(options.pipelineDepth, 1u); ++i){
+		deferRequest();
+	}
+}
+
+/**
+ * Stops sampling and waits for the commands in flight. Do not call it from the I/O thread.
+ */
+void HCSSampler::stop()
+{
+	running = false;
+	std::unique_lock<std::mutex> lock(idleMutex);
+	idle.wait(lock, [this]{ return inFlight == 0; });
+}
+
+bool HCSSampler::isRunning() const
+{
+	return running;
+}
+
+/**
+ * Issues the next command. It is called again from its own callback,
+ * so the device is sampled back to back. A command, that can not be queued
+ * (e.g. the queue is full), is retried with the next turn of the event loop.
+ */
+void HCSSampler::request()
+{
+	const bool setpoint = options.readSetpoint && (!options.readDisplay || sequence++ % 2 == 0);
+	const HCSSample::Source source = setpoint ? HCSSample::Source::GETS : HCSSample::Source::GETD;
+
+	++inFlight;
+	try{
+		hcs.manager->post(hcs, setpoint ? Protocol::encode<Protocol::Command::GETS>() : Protocol::encode<Protocol::Command::GETD>(),
+				[this, source](const std::string& response, std::exception_ptr error){
+			if(error){
+				++errors;
+			}else{
+				received(response, source);
+			}
+
+			if(running && hcs.manager->isRunning()){
+				request();
+			}
+			finished();
+		}, false, options.priority);
+		retrying = false;
+	}catch (std::exception& e) {
+		if(!running || !hcs.manager->isRunning())
+		{
+			// the I/O thread was stopped
+			++errors;
+			running = false;
+			finished();
+			return;
+		}
+
+		// counted and logged once, until a command is queued again
+		if(!retrying)
+		{
+			++errors;
+			MANSON_LOG_WARN("sampler of <" << hcs.uart << "> could not queue a command, it is retried: " << e.what());
+		}
+		retrying = true;
+		deferRequest();
+		finished();
+	}
+}
+
+/**
+ * Calls request() with the next turn of the event loop on the I/O thread
+ */
+void HCSSampler::deferRequest()
+{
+	++inFlight;
+	try{
+		hcs.manager->defer([this]{
+			if(running && hcs.manager->isRunning()){
+				request();
+			}
+			finished();
+		});
+	}catch (...) {
+		// the I/O thread was stopped
+		running = false;
+		finished();
+	}
+}
+
+/**
+ * A command or deferred request is done, the last one wakes up stop()
+ */
+void HCSSampler::finished()
+{
+	std::lock_guard<std::mutex> lock(idleMutex);
+	if(--inFlight == 0){
+		idle.notify_all();
+	}
+}
+
+/**
+ * Parses the response of GETS (VVVCCC) or GETD (VVVVCCCCS) and pushes it to the ring buffer
+ */
+void HCSSampler::received(const std::string& response, HCSSample::Source source)
+{
+	HCSSample sample;
+	Protocol::Measurement m;
+
+	sample.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	sample.source = source;
+
+	const bool valid = (source == HCSSample::Source::GETD) ? Protocol::decodeDisplay(response, m) : Protocol::decodeSetpoint(response, m);
+	if(!valid){
+		++errors;
+		return;
+	}
+	sample.voltage = m.voltage;
+	sample.current = m.current;
+	sample.mode = m.mode;
+
+	ring.push(sample);
+	if(options.observer){
+		options.observer(sample);
+	}
+}
+
+HCSSampler::Ring::Reader HCSSampler::reader()
+{
+	return ring.reader();
+}
+
+bool HCSSampler::latest(HCSSample& sample)
+{
+	return ring.latest(sample);
+}
+
+uint64_t HCSSampler::sampleCount() const
+{
+	return ring.size();
+}
+
+uint64_t HCSSampler::errorCount() const
+{
+	return errors;
+}
@@ -0,0 +1,107 @@
+/*
+ * HCSSampler.h
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#ifndef HCSSAMPLER_H_
+#define HCSSAMPLER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "HCS.h"
+#include "RingBuffer.h"
+
+/**
+ * A parsed reading of the device
+ */
+struct HCSSample {
+	enum class Source : uint8_t {GETS, GETD};
+	using Mode = Protocol::Mode;
+
+	int64_t timestamp;	// steady_clock in ns, when the response was received
+	float voltage;
+	float current;
+	Source source;
+	Mode mode;			// GETD only
+};
+
+/**
+ * Samples a device continuously at the rate the link allows.
+ *
+ * The sampler issues GETD (the measured output) on the I/O thread of the HCSManager,
+ * that owns the device. GETS returns the presets, not measurements, it is issued
+ * in turn with GETD, if readSetpoint is set, or alone, if readDisplay is cleared. Every response is parsed and pushed with
+ * its timestamp to a lock-free ring buffer, so any number of readers can consume
+ * the samples without serial I/O.
+ *
+ *	HCSSampler s(m[0]);
+ *	s.start();
+ *	auto reader = s.reader();
+ *	HCSSample sample;
+ *	while(reader.next(sample)) { ... }
+ */
+class HCSSampler {
+public:
+	static constexpr size_t CAPACITY = 4096;
+	using Ring = RingBuffer<HCSSample, CAPACITY>;
+
+	struct Options {
+		bool readDisplay = true;			// issue GETD, the measured voltage, current and mode
+		bool readSetpoint = false;			// issue GETS, the presets
+		unsigned int pipelineDepth = 1;		// commands in flight at a time
+		Protocol::Priority priority = Protocol::Priority::TELEMETRY;	// SAFETY: waiting setpoints do not delay samples
+		std::function<void(const HCSSample&)> observer;	// called on the I/O thread with every sample, see HCSProtection
+	};
+
+private:
+	HCS& hcs;
+	Options options;
+	Ring ring;
+
+	std::atomic<bool> running{false};
+	std::atomic<unsigned int> inFlight{0};	// commands and deferred requests, that have not called finished() yet
+	std::mutex idleMutex;
+	std::condition_variable idle;			// notified, when inFlight drops to 0, see stop()
+	std::atomic<uint64_t> errors{0};
+	unsigned int sequence = 0;	// selects GETS or GETD, only used on the I/O thread
+	bool retrying = false;		// a command could not be queued, it is retried, see request(). Only used on the I/O thread
+
+	void request();
+	void deferRequest();
+	void finished();
+	void received(const std::string& response, HCSSample::Source source);
+
+	HCSSampler(const HCSSampler &other) = delete;
+	HCSSampler(HCSSampler &&other) = delete;
+	HCSSampler& operator=(const HCSSampler &other) = delete;
+	HCSSampler& operator=(HCSSampler &&other) = delete;
+
+public:
+	explicit HCSSampler(HCS& _hcs) : hcs(_hcs)
+	{
+	}
+	HCSSampler(HCS& _hcs, Options _options) : hcs(_hcs), options(_options)
+	{
+	}
+	virtual ~HCSSampler();
+
+	void start();
+	void stop();
+	bool isRunning() const;
+
+	Ring::Reader reader();
+	bool latest(HCSSample& sample);
+
+	uint64_t sampleCount() const;
+	uint64_t errorCount() const;
+};
+
+#endif /* HCSSAMPLER_H_ */
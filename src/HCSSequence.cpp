@@ -0,0 +1,230 @@
+/*
+ * HCSSequence.cpp
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#include "HCSSequence.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+HCSSequence::HCSSequence(HCS& _hcs) : hcs(_hcs), timeline("sequence")
+{
+}
+
+// the player uses the steps, it is stopped before they are destroyed
+HCSSequence::~HCSSequence()
+{
+	stop();
+}
+
+void HCSSequence::add(std::chrono::milliseconds offset, float voltage, float current)
+{
+	sequence.push_back({offset, voltage, current});
+	prepared = false;
+}
+
+void HCSSequence::add(std::chrono::milliseconds offset, Channel channel, float value)
+{
+	if(channel == Channel::VOLTAGE){
+		add(offset, value, KEEP);
+	}else{
+		add(offset, KEEP, value);
+	}
+}
+
+void HCSSequence::ramp(std::chrono::milliseconds start, std::chrono::milliseconds duration, float from, float to, unsigned int steps, Channel channel)
+{
+	if(steps == 0){
+		throw std::runtime_error("a ramp needs at least one step");
+	}
+	for(unsigned int k = 0; k <= steps; ++k){
+		add(start + duration * k / steps, channel, from + (to - from) * k / steps);
+	}
+}
+
+void HCSSequence::staircase(std::chrono::milliseconds start, std::chrono::milliseconds duration, float from, float delta, unsigned int steps, Channel channel)
+{
+	for(unsigned int k = 0; k < steps; ++k){
+		add(start + duration * k, channel, from + delta * k);
+	}
+}
+
+void HCSSequence::square(std::chrono::milliseconds start, std::chrono::milliseconds period, float low, float high, unsigned int cycles, Channel channel)
+{
+	for(unsigned int c = 0; c < cycles; ++c)
+	{
+		add(start + period * c, channel, high);
+		add(start + period * c + period / 2, channel, low);
+	}
+}
+
+/**
+ * Appends the steps of a sequence file, see HCSSequence
+ */
+void HCSSequence::load(const std::string& path)
+{
+	std::ifstream f(path);
+	if(!f){
+		throw std::runtime_error("could not open sequence file <" + path + ">");
+	}
+
+	auto value = [](const std::string& token) {
+		return (token == "-") ? KEEP : std::stof(token);
+	};
+
+	std::string line;
+	for(unsigned int number = 1; std::getline(f, line); ++number)
+	{
+		line = line.substr(0, line.find('#'));
+		std::istringstream in(line);
+		std::string first;
+		if(!(in >> first)){
+			continue;
+		}
+
+		try{
+			if(first == "ramp" || first == "stair" || first == "square")
+			{
+				std::string channel;
+				long start, duration;
+				float a, b;
+				unsigned int n;
+				if(!(in >> channel >> start >> duration >> a >> b >> n) || (channel != "V" && channel != "A")){
+					throw std::invalid_argument("expected: " + first + " V|A start duration value value count");
+				}
+
+				const Channel c = (channel == "V") ? Channel::VOLTAGE : Channel::CURRENT;
+				if(first == "ramp"){
+					ramp(std::chrono::milliseconds(start), std::chrono::milliseconds(duration), a, b, n, c);
+				}else if(first == "stair"){
+					staircase(std::chrono::milliseconds(start), std::chrono::milliseconds(duration), a, b, n, c);
+				}else{
+					square(std::chrono::milliseconds(start), std::chrono::milliseconds(duration), a, b, n, c);
+				}
+			}
+			else
+			{
+				std::string voltage, current;
+				if(!(in >> voltage >> current)){
+					throw std::invalid_argument("expected: offset voltage current");
+				}
+				add(std::chrono::milliseconds(std::stol(first)), value(voltage), value(current));
+			}
+		}catch (std::exception& e) {
+			throw std::runtime_error("invalid step in <" + path + ":" + std::to_string(number) + ">: " + e.what());
+		}
+	}
+}
+
+void HCSSequence::clear()
+{
+	sequence.clear();
+	prepared = false;
+}
+
+const std::vector<HCSSequence::Step>& HCSSequence::steps() const
+{
+	return sequence;
+}
+
+/**
+ * Sorts the steps by offset and encodes the commands of each offset into one batch.
+ * A setpoint, that exceeds the limits of the device, throws before anything is sent.
+ */
+void HCSSequence::prepare()
+{
+	std::stable_sort(sequence.begin(), sequence.end(), [](const Step& a, const Step& b){ return a.offset < b.offset; });
+
+	commands.clear();
+	firstStep.clear();
+	for(size_t i = 0; i < sequence.size(); ++i)
+	{
+		if(i == 0 || sequence[i].offset != sequence[i - 1].offset){
+			commands.emplace_back(hcs);
+			firstStep.push_back(i);
+		}
+		if(sequence[i].voltage != KEEP){
+			commands.back().setVoltage(sequence[i].voltage);
+		}
+		if(sequence[i].current != KEEP){
+			commands.back().setCurrent(sequence[i].current);
+		}
+	}
+
+	applied.clear();
+	applied.reserve(sequence.size());
+	prepared = true;
+}
+
+void HCSSequence::play()
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	for(size_t i = 0; i < commands.size(); ++i)
+	{
+		const size_t first = firstStep[i];
+		const size_t last = (i + 1 < firstStep.size()) ? firstStep[i + 1] : sequence.size();
+		const auto scheduled = start + sequence[first].offset;
+
+		if(!timeline.waitUntil(scheduled)){
+			break;
+		}
+
+		const auto sent = std::chrono::steady_clock::now();
+		bool ok = true;
+		try{
+			commands[i].execute();
+		}catch (std::exception& e) {
+			MANSON_LOG_ERROR("step <" << first << "> of sequence failed: " << e.what());
+			ok = false;
+		}
+		const auto acknowledged = std::chrono::steady_clock::now();
+
+		for(size_t s = first; s < last; ++s){
+			applied.push_back({s, HCSTimeline::toNanoseconds(scheduled), HCSTimeline::toNanoseconds(sent), HCSTimeline::toNanoseconds(acknowledged), ok});
+		}
+	}
+}
+
+/**
+ * Prepares a run, it is called by the timeline
+ */
+void HCSSequence::reset()
+{
+	if(!prepared){
+		prepare();
+	}
+	applied.clear();
+}
+
+void HCSSequence::run()
+{
+	timeline.run([this]{ reset(); }, [this]{ play(); });
+}
+
+void HCSSequence::start()
+{
+	timeline.start([this]{ reset(); }, [this]{ play(); });
+}
+
+void HCSSequence::stop()
+{
+	timeline.stop();
+}
+
+void HCSSequence::wait()
+{
+	timeline.wait();
+}
+
+const std::vector<HCSSequence::Applied>& HCSSequence::result() const
+{
+	return applied;
+}
@@ -0,0 +1,104 @@
+/*
+ * HCSSequence.h
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#ifndef HCSSEQUENCE_H_
+#define HCSSEQUENCE_H_
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "HCS.h"
+#include "HCSTimeline.h"
+
+/**
+ * Plays timed setpoints on a device.
+ *
+ * Steps are scheduled at absolute offsets from the start of the sequence, so a slow
+ * command delays its own step only, the timing error does not accumulate.
+ * All commands are encoded and validated against the limits of the device by prepare(),
+ * before the first step is sent. The steps of one offset are written with a single write().
+ *
+ *	HCSSequence s(h);
+ *	s.add(std::chrono::milliseconds(0), 5.0f, 1.0f);
+ *	s.ramp(std::chrono::milliseconds(1000), std::chrono::milliseconds(2000), 5.0f, 12.0f, 20);
+ *	s.run();
+ *	for(auto& a : s.result()) { ... }
+ *
+ * A sequence can be loaded from a text file, one step or generator per line:
+ *
+ *	# offset[ms] voltage[V] current[A], - keeps the value
+ *	0      5.0   1.0
+ *	1000   12.0  -
+ *	ramp   V 2000 3000 12.0 24.0 10		# channel start duration from to steps
+ *	stair  V 6000 500  24.0 -2.0 5		# channel start duration from delta steps
+ *	square V 9000 200  5.0  12.0 10		# channel start period low high cycles
+ */
+class HCSSequence {
+public:
+	static constexpr float KEEP = HCSTimeline::KEEP;
+	using Applied = HCSTimeline::Applied;
+
+	enum class Channel {VOLTAGE, CURRENT};
+
+	struct Step {
+		std::chrono::milliseconds offset;
+		float voltage;
+		float current;
+	};
+
+private:
+	HCS& hcs;
+	std::vector<Step> sequence;
+	std::vector<HCS::Batch> commands;	// encoded by prepare(), one batch per offset
+	std::vector<size_t> firstStep;		// first step of each batch
+	std::vector<Applied> applied;
+	bool prepared = false;
+	HCSTimeline timeline;
+
+	void add(std::chrono::milliseconds offset, Channel channel, float value);
+	void reset();
+	void play();
+
+	HCSSequence(const HCSSequence &other) = delete;
+	HCSSequence(HCSSequence &&other) = delete;
+	HCSSequence& operator=(const HCSSequence &other) = delete;
+	HCSSequence& operator=(HCSSequence &&other) = delete;
+
+public:
+	explicit HCSSequence(HCS& _hcs);
+	virtual ~HCSSequence();
+
+	void add(std::chrono::milliseconds offset, float voltage, float current = KEEP);
+
+	// steps+1 setpoints from from to to, evenly spread over duration
+	void ramp(std::chrono::milliseconds start, std::chrono::milliseconds duration, float from, float to, unsigned int steps, Channel channel = Channel::VOLTAGE);
+	// steps setpoints from, from+delta, ... each held for duration
+	void staircase(std::chrono::milliseconds start, std::chrono::milliseconds duration, float from, float delta, unsigned int steps, Channel channel = Channel::VOLTAGE);
+	// cycles of low and high, each held for half of period
+	void square(std::chrono::milliseconds start, std::chrono::milliseconds period, float low, float high, unsigned int cycles, Channel channel = Channel::VOLTAGE);
+
+	void load(const std::string& path);
+	void clear();
+	const std::vector<Step>& steps() const;
+
+	// encodes all commands. It is called by run(), if the sequence was changed
+	void prepare();
+
+	// plays the sequence and blocks until the last step is applied or stop() is called
+	void run();
+	// plays the sequence on a thread
+	void start();
+	void stop();
+	void wait();
+
+	// one entry per applied step, in the order of the steps
+	const std::vector<Applied>& result() const;
+};
+
+#endif /* HCSSEQUENCE_H_ */
@@ -0,0 +1,374 @@
+/*
+ * HCSSimulator.cpp
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#include "HCSSimulator.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+/**
+ * formats value * scale with count digits
+ */
+static std::string format(const float value, const float scale, const int count)
+{
+	char buf[16];
+	const long v = std::min(std::lround(std::max(value, 0.0f) * scale), std::lround(std::pow(10.0f, count)) - 1);
+	snprintf(buf, sizeof(buf), "%0*ld", count, v);
+	return std::string(buf);
+}
+
+/**
+ * parses count decimal digits of s, starting at pos, and divides them by scale
+ */
+static bool parse(const std::string& s, const size_t pos, const size_t count, const float scale, float& value)
+{
+	if(s.length() < pos + count){
+		return false;
+	}
+
+	int v = 0;
+	for(size_t i = pos; i < pos + count; ++i)
+	{
+		if(s[i] < '0' || s[i] > '9'){
+			return false;
+		}
+		v = v * 10 + (s[i] - '0');
+	}
+	value = v / scale;
+	return true;
+}
+
+HCSSimulator::HCSSimulator() : HCSSimulator(Options())
+{
+}
+
+HCSSimulator::HCSSimulator(Options _options) : options(_options), rng(_options.seed)
+{
+	preset = {0.0f, 0.0f};
+	limit = {options.maxVoltage, options.maxCurrent};
+	for(Preset& m : memory){
+		m = {0.0f, 0.0f};
+	}
+	loadResistance = options.loadResistance;
+	output = {0.0f, 0.0f};
+
+	if(!options.terminal){
+		return;
+	}
+
+	if((master = posix_openpt(O_RDWR | O_NOCTTY)) < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+	{
+		std::string msg = std::string(strerror(errno));
+		if(master >= 0){
+			close(master);
+		}
+		throw std::runtime_error("could not open pseudo terminal for simulation: " + msg);
+	}
+	slaveName = ptsname(master);
+
+	// the simulator keeps the slave open, so the master does not hang up, when the library disconnects.
+	// raw mode prevents an echo of commands, before the library has configured the terminal
+	if((slave = open(slaveName.c_str(), O_RDWR | O_NOCTTY)) < 0)
+	{
+		std::string msg = std::string(strerror(errno));
+		close(master);
+		throw std::runtime_error("could not open <" + slaveName + "> for simulation: " + msg);
+	}
+	struct termios t;
+	tcgetattr(slave, &t);
+	cfmakeraw(&t);
+	tcsetattr(slave, TCSANOW, &t);
+
+	running = true;
+	worker = std::thread(&HCSSimulator::serve, this);
+}
+
+HCSSimulator::~HCSSimulator()
+{
+	if(!options.terminal){
+		return;
+	}
+	running = false;
+	worker.join();
+	close(slave);
+	close(master);
+}
+
+const std::string& HCSSimulator::device() const
+{
+	return slaveName;
+}
+
+HCSSimulator::Preset HCSSimulator::getPreset() const
+{
+	std::lock_guard<std::mutex> lock(stateMutex);
+	return preset;
+}
+
+HCSSimulator::Preset HCSSimulator::getUpperLimits() const
+{
+	std::lock_guard<std::mutex> lock(stateMutex);
+	return limit;
+}
+
+void HCSSimulator::setLoadResistance(const float ohm)
+{
+	std::lock_guard<std::mutex> lock(stateMutex);
+	follow();
+	loadResistance = ohm;
+}
+
+uint64_t HCSSimulator::commandCount() const
+{
+	return commands;
+}
+
+/**
+ * time to transfer one byte (8N1) at the configured baud rate
+ */
+std::chrono::nanoseconds HCSSimulator::byteTime() const
+{
+	if(options.baud == 0){
+		return std::chrono::nanoseconds(0);
+	}
+	return std::chrono::nanoseconds(10 * 1000000000ull / options.baud);
+}
+
+/**
+ * Output of the supply with a resistive load. The supply regulates the voltage (CV),
+ * until the load draws more than the preset current (CC). Both are clamped by the
+ * upper limits. stateMutex has to be locked.
+ */
+void HCSSimulator::regulate(float& voltage, float& current, bool& cc) const
+{
+	const float v = std::min(preset.voltage, limit.voltage);
+	const float i = std::min(preset.current, limit.current);
+
+	if(loadResistance <= 0.0f)
+	{
+		voltage = v;
+		current = 0.0f;
+		cc = false;
+	}
+	else if(v / loadResistance > i)
+	{
+		voltage = i * loadResistance;
+		current = i;
+		cc = true;
+	}
+	else
+	{
+		voltage = v;
+		current = v / loadResistance;
+		cc = false;
+	}
+}
+
+/**
+ * Displayed output. After a change, the output approaches the regulated values
+ * exponentially with the time constant options.settle. stateMutex has to be locked.
+ */
+void HCSSimulator::display(float& voltage, float& current, bool& cc) const
+{
+	regulate(voltage, current, cc);
+	if(options.settle.count() <= 0){
+		return;
+	}
+
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - changed;
+	const float a = static_cast<float>(std::exp(-elapsed.count() / std::chrono::duration<double>(options.settle).count()));
+	voltage += (output.voltage - voltage) * a;
+	current += (output.current - current) * a;
+}
+
+/**
+ * The output starts to follow changed presets, limits or load from the displayed values.
+ * stateMutex has to be locked.
+ */
+void HCSSimulator::follow()
+{
+	bool cc;
+	display(output.voltage, output.current, cc);
+	changed = std::chrono::steady_clock::now();
+}
+
+void HCSSimulator::serve()
+{
+	std::string line;
+	char buf[256];
+
+	while(running)
+	{
+		struct pollfd p = {master, POLLIN, 0};
+		if(poll(&p, 1, 50) <= 0 || !(p.revents & POLLIN)){
+			continue;
+		}
+
+		const ssize_t n = read(master, buf, sizeof(buf));
+		const auto received = std::chrono::steady_clock::now();
+
+		for(ssize_t i = 0; i < n; ++i)
+		{
+			if(buf[i] == '\r')
+			{
+				// the command is complete, after its last byte was transferred
+				const auto transferred = received + byteTime() * (line.length() + 1);
+				++commands;
+				reply(process(line), transferred);
+				line.clear();
+			}
+			else if(buf[i] != '\n')
+			{
+				line += buf[i];
+			}
+		}
+	}
+}
+
+/**
+ * Executes a command and returns the complete reply. Unknown or malformed commands
+ * are not answered, like by the device.
+ */
+std::string HCSSimulator::process(const std::string& cmd)
+{
+	static const std::string OK = "OK\r";
+	std::lock_guard<std::mutex> lock(stateMutex);
+	float value;
+
+	const std::string mnemonic = cmd.substr(0, 4);
+	const size_t arguments = cmd.length() - mnemonic.length();
+
+	if(mnemonic == "GMAX" && arguments == 0){
+		return format(options.maxVoltage, 10, 3) + format(options.maxCurrent, 10, 3) + "\r" + OK;
+	}
+	if(mnemonic == "GETS" && arguments == 0){
+		return format(preset.voltage, 10, 3) + format(preset.current, 10, 3) + "\r" + OK;
+	}
+	if(mnemonic == "GETD" && arguments == 0)
+	{
+		float voltage, current;
+		bool cc;
+		display(voltage, current, cc);
+		return format(voltage, 100, 4) + format(current, 100, 4) + (cc ? "1" : "0") + "\r" + OK;
+	}
+	if(mnemonic == "GOVP" && arguments == 0){
+		return format(limit.voltage, 10, 3) + "\r" + OK;
+	}
+	if(mnemonic == "GOCP" && arguments == 0){
+		return format(limit.current, 10, 3) + "\r" + OK;
+	}
+	if(mnemonic == "GETM" && arguments == 0)
+	{
+		std::string response;
+		for(const Preset& m : memory){
+			response += format(m.voltage, 10, 3) + format(m.current, 10, 3) + "\r";
+		}
+		return response + OK;
+	}
+	if(mnemonic == "VOLT" && arguments == 3 && parse(cmd, 4, 3, 10, value) && value <= options.maxVoltage){
+		follow();
+		preset.voltage = value;
+		return OK;
+	}
+	if(mnemonic == "CURR" && arguments == 3 && parse(cmd, 4, 3, 10, value) && value <= options.maxCurrent){
+		follow();
+		preset.current = value;
+		return OK;
+	}
+	if(mnemonic == "SOVP" && arguments == 3 && parse(cmd, 4, 3, 10, value) && value <= options.maxVoltage){
+		follow();
+		limit.voltage = value;
+		return OK;
+	}
+	if(mnemonic == "SOCP" && arguments == 3 && parse(cmd, 4, 3, 10, value) && value <= options.maxCurrent){
+		follow();
+		limit.current = value;
+		return OK;
+	}
+	if(mnemonic == "RUNM" && arguments == 1 && parse(cmd, 4, 1, 1, value) && value < 3){
+		follow();
+		preset = memory[static_cast<int>(value)];
+		return OK;
+	}
+	if(mnemonic == "PROM" && arguments == 18)
+	{
+		Preset m[3];
+		for(int i = 0; i < 3; ++i)
+		{
+			if(!parse(cmd, 4 + i * 6, 3, 10, m[i].voltage) || !parse(cmd, 7 + i * 6, 3, 10, m[i].current)){
+				return "";
+			}
+		}
+		std::copy(m, m + 3, memory);
+		return OK;
+	}
+	return "";
+}
+
+/**
+ * Drops the reply or garbles one of its bytes at the configured rates.
+ * returns false, if the reply is dropped
+ */
+bool HCSSimulator::corrupt(std::string& response)
+{
+	if(response.empty()){
+		return false;
+	}
+	if(options.dropRate > 0.0 && std::bernoulli_distribution(options.dropRate)(rng)){
+		return false;
+	}
+	if(options.garbleRate > 0.0 && std::bernoulli_distribution(options.garbleRate)(rng)){
+		response[std::uniform_int_distribution<size_t>(0, response.length() - 1)(rng)] ^= 0x5a;
+	}
+	return true;
+}
+
+std::string HCSSimulator::respond(const std::string& command)
+{
+	++commands;
+	std::string r = process(command);
+	return corrupt(r) ? r : std::string();
+}
+
+/**
+ * Sends the reply after the configured latency. The bytes are paced at the baud rate,
+ * a reply may be dropped or one of its bytes garbled.
+ */
+void HCSSimulator::reply(const std::string& response, std::chrono::steady_clock::time_point received)
+{
+	std::string r = response;
+	if(!corrupt(r)){
+		return;
+	}
+
+	auto next = received + options.latency;
+	std::this_thread::sleep_until(next);
+
+	if(options.baud == 0){
+		ssize_t ret = write(master, r.data(), r.length());
+		(void)ret;
+		return;
+	}
+
+	for(const char c : r)
+	{
+		next += byteTime();
+		std::this_thread::sleep_until(next);
+		ssize_t ret = write(master, &c, 1);
+		(void)ret;
+	}
+}
@@ -0,0 +1,100 @@
+/*
+ * HCSSimulator.h
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#ifndef HCSSIMULATOR_H_
+#define HCSSIMULATOR_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+/**
+ * Simulates a HCS device on a pseudo terminal or in memory (see LoopbackTransport).
+ *
+ * The simulator implements the UART protocol of the device (GMAX, VOLT, CURR, GETS,
+ * GETD, GOVP, SOVP, GOCP, SOCP, GETM, RUNM, PROM). The library connects to device()
+ * like to a USB device. Reply latency, baud rate pacing, dropped or garbled replies
+ * a resistive load and the settling time of the output can be configured, so the library
+ * can be tested without hardware.
+ */
+class HCSSimulator {
+public:
+	struct Options {
+		float maxVoltage = 32.0f;
+		float maxCurrent = 5.0f;
+		std::chrono::microseconds latency{0};	// processing time of a command
+		unsigned int baud = 0;					// paces the transfer of commands and replies, 0 disables pacing
+		double dropRate = 0.0;					// probability, that a reply is not sent
+		double garbleRate = 0.0;				// probability, that a byte of a reply is corrupted
+		float loadResistance = 0.0f;			// resistive load at the output in Ohm, 0 is an open output
+		std::chrono::microseconds settle{0};	// time constant of the output after a change, 0 follows at once
+		unsigned int seed = 1;
+		bool terminal = true;					// false: there is no pseudo terminal, commands are passed to respond()
+	};
+
+	struct Preset {
+		float voltage;
+		float current;
+	};
+
+private:
+	Options options;
+	int master = -1;
+	int slave = -1;
+	std::string slaveName;
+
+	std::thread worker;
+	std::atomic<bool> running{false};
+	std::atomic<uint64_t> commands{0};
+	std::mt19937 rng;
+
+	mutable std::mutex stateMutex;
+	Preset preset;
+	Preset limit;
+	Preset memory[3];
+	float loadResistance;
+	Preset output;							// displayed values, when the output started to follow
+	std::chrono::steady_clock::time_point changed;
+
+	void serve();
+	std::string process(const std::string& cmd);
+	void reply(const std::string& response, std::chrono::steady_clock::time_point received);
+	bool corrupt(std::string& response);
+	void regulate(float& voltage, float& current, bool& cc) const;
+	void display(float& voltage, float& current, bool& cc) const;
+	void follow();
+	std::chrono::nanoseconds byteTime() const;
+
+	HCSSimulator(const HCSSimulator &other) = delete;
+	HCSSimulator(HCSSimulator &&other) = delete;
+	HCSSimulator& operator=(const HCSSimulator &other) = delete;
+	HCSSimulator& operator=(HCSSimulator &&other) = delete;
+
+public:
+	HCSSimulator();
+	explicit HCSSimulator(Options _options);
+	virtual ~HCSSimulator();
+
+	// path of the pseudo terminal, that is passed to HCS
+	const std::string& device() const;
+
+	// answers a command without "\r\n" immediately, for a LoopbackTransport.
+	// Replies are dropped or garbled like on the terminal, latency and pacing do not apply
+	std::string respond(const std::string& command);
+
+	Preset getPreset() const;
+	Preset getUpperLimits() const;
+	void setLoadResistance(const float ohm);
+	uint64_t commandCount() const;
+};
+
+#endif /* HCSSIMULATOR_H_ */
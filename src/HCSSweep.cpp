@@ -0,0 +1,297 @@
+/*
+ * HCSSweep.cpp
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#include "HCSSweep.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+static constexpr uint32_t SWEEP_VERSION = 1;
+static const char SWEEP_MAGIC[8] = {'M', 'A', 'N', 'S', 'O', 'N', 'I', 'V'};
+
+// VOLT has a resolution of 100mV
+static float toSetpoint(const float voltage)
+{
+	return std::round(voltage * 10.0f) / 10.0f;
+}
+
+static uint16_t toHundredths(const float value)
+{
+	return static_cast<uint16_t>(std::lround(std::max(0.0f, value) * 100.0f));
+}
+
+HCSSweep::HCSSweep(HCS& _hcs, Options _options) : hcs(_hcs), options(_options)
+{
+}
+
+/**
+ * Sets the voltage and reads the output, until it is settled or settleTimeout expired.
+ * The setpoint and the first reading are written at once. That reading shows the output,
+ * before a supply has started to slew, it does not count. The output is settled, when
+ * stableReadings consecutive readings agree and are at the target: the setpoint in CV,
+ * or any voltage in CC.
+ */
+HCSSweep::Point HCSSweep::measure(const float setpoint, const unsigned int pass)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	HCS::Batch b(hcs);
+	b.setVoltage(setpoint);
+	const size_t getd = b.readStatus();
+	b.execute();
+
+	Protocol::Measurement last;
+	if(!Protocol::decodeDisplay(b.response(getd), last)){
+		throw std::runtime_error("malformed display values <" + b.response(getd) + "> received in sweep");
+	}
+	auto read = std::chrono::steady_clock::now();
+
+	Point p = {setpoint, last.voltage, last.current, last.mode, false, 1, pass, std::chrono::microseconds(0)};
+	unsigned int stable = 0;
+	while(true)
+	{
+		if(stable >= std::max(options.stableReadings, 1u)){
+			p.settled = true;
+			break;
+		}
+		if(read - start >= options.settleTimeout || cancelled){
+			break;
+		}
+		std::this_thread::sleep_until(read + options.interval);
+
+		const Protocol::Measurement m = hcs.readDisplay();
+		read = std::chrono::steady_clock::now();
+		++p.readings;
+
+		const bool arrived = (m.mode == Protocol::Mode::CC) || std::fabs(m.voltage - setpoint) <= options.voltageTolerance;
+		const bool agree = std::fabs(m.voltage - last.voltage) <= options.voltageTolerance
+				&& std::fabs(m.current - last.current) <= options.currentTolerance && m.mode == last.mode;
+		if(!arrived){
+			stable = 0;
+		}else{
+			stable = (stable > 0 && agree) ? stable + 1 : 1;
+		}
+		last = m;
+	}
+
+	p.voltage = last.voltage;
+	p.current = last.current;
+	p.mode = last.mode;
+	p.settle = std::chrono::duration_cast<std::chrono::microseconds>(read - start);
+	if(!p.settled){
+		MANSON_LOG_WARN("output of <" << hcs.uart << "> did not settle at <" << setpoint << " V> within <" << p.settle.count() << " us>");
+	}
+	return p;
+}
+
+/**
+ * dI/dV of the interval between point k and k + 1
+ */
+float HCSSweep::slope(const size_t k) const
+{
+	return (points[k + 1].current - points[k].current) / (points[k + 1].setpoint - points[k].setpoint);
+}
+
+/**
+ * Midpoints of the intervals next to points, where dI/dV changes by more than
+ * slopeChange relative to the steeper side. Changes, that are within the current
+ * tolerance over the interval, are noise.
+ */
+std::vector<float> HCSSweep::refine() const
+{
+	std::vector<float> midpoints;
+	if(options.minStep <= 0.0f){
+		return midpoints;
+	}
+
+	for(size_t k = 1; k + 1 < points.size(); ++k)
+	{
+		const float before = slope(k - 1);
+		const float after = slope(k);
+		const float change = std::fabs(after - before);
+		const float width = std::min(points[k].setpoint - points[k - 1].setpoint, points[k + 1].setpoint - points[k].setpoint);
+
+		if(change <= options.slopeChange * std::max(std::fabs(before), std::fabs(after)) || change * width <= options.currentTolerance){
+			continue;
+		}
+		for(size_t i = k - 1; i <= k; ++i)
+		{
+			const float low = points[i].setpoint;
+			const float high = points[i + 1].setpoint;
+			const float mid = toSetpoint((low + high) / 2.0f);
+			if(high - low >= 2.0f * options.minStep && mid > low && mid < high && (midpoints.empty() || midpoints.back() != mid)){
+				midpoints.push_back(mid);
+			}
+		}
+	}
+	return midpoints;
+}
+
+void HCSSweep::run()
+{
+	if(options.step <= 0.0f || options.to < options.from){
+		throw std::runtime_error("sweep needs a positive step from <" + std::to_string(options.from) + "> to <" + std::to_string(options.to) + ">");
+	}
+	cancelled = false;
+	points.clear();
+
+	const auto start = std::chrono::steady_clock::now();
+	if(options.current != KEEP){
+		hcs.setCurrent(options.current);
+	}
+
+	// a setpoint above the upper voltage limit (OVP) or the maximum is rejected, the sweep ends there.
+	// The refinement only halves intervals of measured points, it stays below the limit as well
+	const float to = std::min({options.to, hcs.getMaxVoltage(), hcs.getUpperLimits().first});
+	if(to < options.from){
+		throw std::runtime_error("sweep from <" + std::to_string(options.from) + "> is above the upper voltage limit <" + std::to_string(to) + ">");
+	}
+	if(to < options.to){
+		MANSON_LOG_WARN("sweep of <" << hcs.uart << "> ends at the upper voltage limit <" << to << " V> instead of <" << options.to << " V>");
+	}
+
+	float previous = -1.0f;
+	for(unsigned int k = 0; options.from + options.step * k <= to + 0.001f && points.size() < options.maxPoints && !cancelled; ++k)
+	{
+		const float setpoint = toSetpoint(options.from + options.step * k);
+		if(setpoint != previous){
+			points.push_back(measure(setpoint, 0));
+		}
+		previous = setpoint;
+	}
+
+	unsigned int pass = 1;
+	for(; !cancelled && points.size() < options.maxPoints; ++pass)
+	{
+		const std::vector<float> midpoints = refine();
+		if(midpoints.empty()){
+			break;
+		}
+		for(float setpoint : midpoints)
+		{
+			if(cancelled || points.size() >= options.maxPoints){
+				break;
+			}
+			const Point p = measure(setpoint, pass);
+			points.insert(std::upper_bound(points.begin(), points.end(), p,
+					[](const Point& a, const Point& b){ return a.setpoint < b.setpoint; }), p);
+		}
+	}
+
+	const size_t unsettled = std::count_if(points.begin(), points.end(), [](const Point& p){ return !p.settled; });
+	MANSON_LOG_INFO("sweep of <" << hcs.uart << "> measured <" << points.size() << "> points in <" << pass << "> passes and <"
+			<< std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()
+			<< " ms>, <" << unsettled << "> did not settle");
+}
+
+void HCSSweep::stop()
+{
+	cancelled = true;
+}
+
+const std::vector<HCSSweep::Point>& HCSSweep::result() const
+{
+	return points;
+}
+
+void HCSSweep::writeCsv(const std::string& path) const
+{
+	FILE *out = std::fopen(path.c_str(), "w");
+	if(out == nullptr)
+	{
+		std::string msg = std::string(strerror(errno));
+		throw std::runtime_error("could not create sweep file <" + path + ">: " + msg);
+	}
+
+	static const char *MODE[] = {"", "CV", "CC"};
+
+	std::fprintf(out, "setpoint,voltage,current,mode,settled,readings,settle_us,pass\n");
+	for(const Point& p : points)
+	{
+		const size_t mode = static_cast<size_t>(p.mode);
+		std::fprintf(out, "%.1f,%.2f,%.2f,%s,%d,%u,%lld,%u\n", p.setpoint, p.voltage, p.current, (mode < 3) ? MODE[mode] : "",
+				p.settled ? 1 : 0, p.readings, static_cast<long long>(p.settle.count()), p.pass);
+	}
+	std::fclose(out);
+}
+
+void HCSSweep::writeBinary(const std::string& path) const
+{
+	FILE *out = std::fopen(path.c_str(), "wb");
+	if(out == nullptr)
+	{
+		std::string msg = std::string(strerror(errno));
+		throw std::runtime_error("could not create sweep file <" + path + ">: " + msg);
+	}
+
+	SweepHeader h = {};
+	std::memcpy(h.magic, SWEEP_MAGIC, sizeof(h.magic));
+	h.version = SWEEP_VERSION;
+	h.recordSize = sizeof(SweepRecord);
+	h.recordCount = points.size();
+	h.created = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+	std::vector<SweepRecord> records;
+	for(const Point& p : points)
+	{
+		SweepRecord r = {};
+		r.setpoint = toHundredths(p.setpoint);
+		r.voltage = toHundredths(p.voltage);
+		r.current = toHundredths(p.current);
+		r.mode = static_cast<uint8_t>(p.mode);
+		r.flags = p.settled ? SweepRecord::SETTLED : 0;
+		r.settle = static_cast<uint32_t>(std::min<int64_t>(p.settle.count(), UINT32_MAX));
+		r.readings = static_cast<uint16_t>(std::min<unsigned int>(p.readings, UINT16_MAX));
+		r.pass = static_cast<uint8_t>(std::min<unsigned int>(p.pass, UINT8_MAX));
+		records.push_back(r);
+	}
+
+	const bool ok = std::fwrite(&h, sizeof(h), 1, out) == 1
+			&& std::fwrite(records.data(), sizeof(SweepRecord), records.size(), out) == records.size();
+	if(std::fclose(out) != 0 || !ok){
+		throw std::runtime_error("could not write sweep file <" + path + ">");
+	}
+}
+
+std::vector<HCSSweep::Point> HCSSweep::readBinary(const std::string& path)
+{
+	FILE *in = std::fopen(path.c_str(), "rb");
+	if(in == nullptr)
+	{
+		std::string msg = std::string(strerror(errno));
+		throw std::runtime_error("could not open sweep file <" + path + ">: " + msg);
+	}
+
+	SweepHeader h;
+	if(std::fread(&h, sizeof(h), 1, in) != 1 || std::memcmp(h.magic, SWEEP_MAGIC, sizeof(h.magic)) != 0
+			|| h.version != SWEEP_VERSION || h.recordSize != sizeof(SweepRecord))
+	{
+		std::fclose(in);
+		throw std::runtime_error("<" + path + "> is not a sweep file of version " + std::to_string(SWEEP_VERSION));
+	}
+
+	std::vector<Point> result;
+	SweepRecord r;
+	while(result.size() < h.recordCount && std::fread(&r, sizeof(r), 1, in) == 1)
+	{
+		result.push_back({r.setpoint / 100.0f, r.voltage / 100.0f, r.current / 100.0f, static_cast<Protocol::Mode>(r.mode),
+				(r.flags & SweepRecord::SETTLED) != 0, r.readings, r.pass, std::chrono::microseconds(r.settle)});
+	}
+	std::fclose(in);
+
+	if(result.size() != h.recordCount){
+		throw std::runtime_error("sweep file <" + path + "> is too short");
+	}
+	return result;
+}
@@ -0,0 +1,131 @@
+/*
+ * HCSSweep.h
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#ifndef HCSSWEEP_H_
+#define HCSSWEEP_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "HCS.h"
+
+/**
+ * Binary sweep file:
+ *	SweepHeader, followed by recordCount records of recordSize bytes, ordered by setpoint.
+ * All values are stored in host byte order.
+ */
+struct SweepHeader {
+	char magic[8];			// "MANSONIV"
+	uint32_t version;
+	uint32_t recordSize;
+	uint64_t recordCount;
+	int64_t created;		// system_clock in ns, when the file was created
+	uint8_t reserved[32];
+};
+static_assert(sizeof(SweepHeader) == 64, "SweepHeader has to be 64 bytes");
+
+struct SweepRecord {
+	static constexpr uint8_t SETTLED = 1;
+
+	uint16_t setpoint;		// 10mV
+	uint16_t voltage;		// 10mV
+	uint16_t current;		// 10mA
+	uint8_t mode;			// Protocol::Mode
+	uint8_t flags;			// SETTLED
+	uint32_t settle;		// us from the setpoint to the settled reading
+	uint16_t readings;		// GETD readings of the point
+	uint8_t pass;			// 0 is the coarse pass, refinements follow
+	uint8_t reserved;
+};
+static_assert(sizeof(SweepRecord) == 16, "SweepRecord has to be 16 bytes");
+
+/**
+ * Characterizes the output of a device over a voltage range (I-V curve).
+ *
+ * For each point the setpoint and the first readback (GETD) are written with a single
+ * write(). The output is read until stableReadings consecutive readings agree within
+ * the tolerances and show the setpoint in CV (or the CC flag), instead of waiting a fixed
+ * time. The readback sent with the setpoint does not count. GETS returns the presets,
+ * so settling is detected from the displayed values.
+ *
+ * After the coarse pass, the intervals next to points, where dI/dV changes sharply
+ * (e.g. the transition from CV to CC), are halved down to minStep:
+ *
+ *	HCSSweep::Options o;
+ *	o.to = 12.0f;
+ *	o.step = 1.0f;
+ *	HCSSweep s(h, o);
+ *	s.run();
+ *	s.writeCsv("iv.csv");
+ */
+class HCSSweep {
+public:
+	static constexpr float KEEP = -1.0f;	// the current is not set
+
+	struct Options {
+		float from = 0.0f;
+		float to = 32.0f;
+		float step = 2.0f;
+		float current = KEEP;				// current preset for the sweep
+		float voltageTolerance = 0.05f;		// consecutive readings agree within the tolerances, a CV reading with the setpoint
+		float currentTolerance = 0.02f;
+		unsigned int stableReadings = 2;
+		std::chrono::milliseconds interval{20};		// minimum time between readings of a point
+		std::chrono::milliseconds settleTimeout{1500};	// the point is not settled, if it takes longer
+		float minStep = 0.1f;				// 0 disables the refinement
+		float slopeChange = 0.5f;			// relative change of dI/dV, that is refined
+		size_t maxPoints = 1000;
+	};
+
+	struct Point {
+		float setpoint;
+		float voltage;
+		float current;
+		Protocol::Mode mode;
+		bool settled;
+		unsigned int readings;
+		unsigned int pass;
+		std::chrono::microseconds settle;
+	};
+
+private:
+	HCS& hcs;
+	Options options;
+	std::vector<Point> points;	// ordered by setpoint
+	std::atomic<bool> cancelled{false};
+
+	Point measure(const float setpoint, const unsigned int pass);
+	std::vector<float> refine() const;
+	float slope(const size_t k) const;
+
+	HCSSweep(const HCSSweep &other) = delete;
+	HCSSweep(HCSSweep &&other) = delete;
+	HCSSweep& operator=(const HCSSweep &other) = delete;
+	HCSSweep& operator=(HCSSweep &&other) = delete;
+
+public:
+	HCSSweep(HCS& _hcs, Options _options);
+	virtual ~HCSSweep() = default;
+
+	// sweeps and refines, blocks until all points are measured or stop() is called
+	void run();
+	// cancels run() after the point in progress
+	void stop();
+
+	const std::vector<Point>& result() const;
+
+	// the result as CSV or binary file, see SweepHeader
+	void writeCsv(const std::string& path) const;
+	void writeBinary(const std::string& path) const;
+	static std::vector<Point> readBinary(const std::string& path);
+};
+
+#endif /* HCSSWEEP_H_ */
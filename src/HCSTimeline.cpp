@@ -0,0 +1,137 @@
+/*
+ * HCSTimeline.cpp
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#include "HCSTimeline.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+HCSTimeline::HCSTimeline(const std::string& _owner) : owner(_owner)
+{
+	// steady_clock is CLOCK_MONOTONIC, the timer fires at absolute steady_clock time points
+	if((timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0 || (stopFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0)
+	{
+		std::string msg = std::string(strerror(errno));
+		if(timerFd >= 0){
+			close(timerFd);
+		}
+		throw std::runtime_error("could not create timer for " + owner + ": " + msg);
+	}
+}
+
+HCSTimeline::~HCSTimeline()
+{
+	stop();
+	close(stopFd);
+	close(timerFd);
+}
+
+int64_t HCSTimeline::toNanoseconds(const std::chrono::steady_clock::time_point t)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+/**
+ * Sleeps until t. returns false, if stop() was called
+ */
+bool HCSTimeline::waitUntil(std::chrono::steady_clock::time_point t)
+{
+	struct itimerspec spec = {};
+	const int64_t ns = toNanoseconds(t);
+	spec.it_value.tv_sec = ns / 1000000000;
+	spec.it_value.tv_nsec = ns % 1000000000;
+
+	if(!running){
+		return false;
+	}
+
+	// an expired time point fires immediately, a zero time point would disarm the timer
+	if(ns <= 0 || timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr) < 0){
+		return running;
+	}
+
+	struct pollfd fds[2] = {{timerFd, POLLIN, 0}, {stopFd, POLLIN, 0}};
+	while(poll(fds, 2, -1) < 0 && errno == EINTR){
+	}
+
+	uint64_t expirations;
+	if(fds[0].revents & POLLIN){
+		ssize_t ret = read(timerFd, &expirations, sizeof(expirations));
+		(void)ret;
+	}
+	return running;
+}
+
+/**
+ * Prepares a run. running has to be set already
+ */
+void HCSTimeline::reset(const Prepare& prepare)
+{
+	uint64_t pending;
+	while(read(stopFd, &pending, sizeof(pending)) > 0){
+	}
+
+	try{
+		prepare();
+	}catch (...) {
+		running = false;
+		throw;
+	}
+}
+
+void HCSTimeline::run(const Prepare& prepare, Play play)
+{
+	if(running.exchange(true)){
+		throw std::runtime_error(owner + " is already running");
+	}
+	reset(prepare);
+	try{
+		play();
+	}catch (...) {
+		running = false;
+		throw;
+	}
+	running = false;
+}
+
+void HCSTimeline::start(const Prepare& prepare, Play play)
+{
+	wait();
+	if(running.exchange(true)){
+		throw std::runtime_error(owner + " is already running");
+	}
+	reset(prepare);
+	worker = std::thread([this, play]{
+		play();
+		running = false;
+	});
+}
+
+void HCSTimeline::stop()
+{
+	if(running.exchange(false))
+	{
+		uint64_t one = 1;
+		ssize_t ret = write(stopFd, &one, sizeof(one));
+		(void)ret;
+	}
+	wait();
+}
+
+void HCSTimeline::wait()
+{
+	if(worker.joinable()){
+		worker.join();
+	}
+}
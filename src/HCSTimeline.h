@@ -0,0 +1,73 @@
+/*
+ * HCSTimeline.h
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#ifndef HCSTIMELINE_H_
+#define HCSTIMELINE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+/**
+ * Plays steps at absolute time points on the calling thread or a worker, see HCSSequence and HCSGroup.
+ *
+ * The time points are steady_clock (CLOCK_MONOTONIC), a timerfd fires at them, so the
+ * timing error of a step does not accumulate. stop() wakes a waiting player at once.
+ */
+class HCSTimeline {
+public:
+	static constexpr float KEEP = -1.0f;	// the value is not changed by a step
+
+	// timestamps are steady_clock in ns
+	struct Applied {
+		size_t step;			// index in the steps of the owner
+		int64_t scheduled;
+		int64_t sent;			// the commands were written
+		int64_t acknowledged;	// the device answered OK
+		bool ok;
+	};
+
+	// called once per run before play, it may throw
+	using Prepare = std::function<void()>;
+	using Play = std::function<void()>;
+
+private:
+	std::string owner;		// for error messages
+	int timerFd = -1;
+	int stopFd = -1;
+	std::thread worker;
+	std::atomic<bool> running{false};
+
+	void reset(const Prepare& prepare);
+
+	HCSTimeline(const HCSTimeline &other) = delete;
+	HCSTimeline(HCSTimeline &&other) = delete;
+	HCSTimeline& operator=(const HCSTimeline &other) = delete;
+	HCSTimeline& operator=(HCSTimeline &&other) = delete;
+
+public:
+	explicit HCSTimeline(const std::string& _owner);
+	virtual ~HCSTimeline();
+
+	static int64_t toNanoseconds(const std::chrono::steady_clock::time_point t);
+
+	// plays and blocks until play returns or stop() is called
+	void run(const Prepare& prepare, Play play);
+	// plays on a thread
+	void start(const Prepare& prepare, Play play);
+	void stop();
+	void wait();
+
+	// sleeps until t. returns false, if stop() was called. Used by play
+	bool waitUntil(std::chrono::steady_clock::time_point t);
+};
+
+#endif /* HCSTIMELINE_H_ */
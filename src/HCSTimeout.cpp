@@ -0,0 +1,98 @@
+/*
+ * HCSTimeout.cpp
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#include "HCSTimeout.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+void HCSTimeoutPolicy::setOptions(const Options& _options)
+{
+	if(_options.tries == 0 || _options.minTimeout > _options.maxTimeout){
+		throw std::runtime_error("invalid timeout policy, a command needs at least one try and minTimeout <= maxTimeout");
+	}
+	options = _options;
+}
+
+const HCSTimeoutPolicy::Options& HCSTimeoutPolicy::getOptions() const
+{
+	return options;
+}
+
+void HCSTimeoutPolicy::setBaud(const unsigned int _baud)
+{
+	baud = _baud;
+}
+
+std::chrono::microseconds HCSTimeoutPolicy::wireTime(const Protocol::Frame& cmd, const bool followsResponse) const
+{
+	const size_t response = Protocol::responseFrameLength(cmd.command);
+	const int64_t bits = static_cast<int64_t>((followsResponse ? 0 : cmd.length) + response) * options.bitsPerByte;
+
+	return std::chrono::microseconds((baud > 0) ? bits * 1000000 / baud : 0);
+}
+
+std::chrono::microseconds HCSTimeoutPolicy::timeout(const Protocol::Frame& cmd, const unsigned int failures, const bool followsResponse) const
+{
+	const int64_t smoothed = srtt.load(std::memory_order_relaxed);
+	std::chrono::microseconds turnaround = options.initialTimeout;
+
+	if(options.adaptive && smoothed >= 0){
+		turnaround = std::chrono::microseconds(smoothed + std::max<int64_t>(options.granularity.count(), 4 * rttvar.load(std::memory_order_relaxed)));
+	}
+
+	std::chrono::microseconds t = wireTime(cmd, followsResponse) + turnaround;
+	for(unsigned int i = 0; i < failures && t < options.maxTimeout; ++i){
+		t *= 2;
+	}
+	return std::clamp(t, options.minTimeout, options.maxTimeout);
+}
+
+std::chrono::microseconds HCSTimeoutPolicy::resendDelay() const
+{
+	return options.resendDelay;
+}
+
+unsigned int HCSTimeoutPolicy::tries() const
+{
+	return options.tries;
+}
+
+void HCSTimeoutPolicy::sample(const Protocol::Frame& cmd, const std::chrono::microseconds roundTrip, const bool followsResponse)
+{
+	const int64_t r = std::max<int64_t>((roundTrip - wireTime(cmd, followsResponse)).count(), 0);
+	const int64_t smoothed = srtt.load(std::memory_order_relaxed);
+
+	if(smoothed < 0)
+	{
+		srtt.store(r, std::memory_order_relaxed);
+		rttvar.store(r / 2, std::memory_order_relaxed);
+		return;
+	}
+
+	const int64_t var = rttvar.load(std::memory_order_relaxed);
+	rttvar.store((3 * var + std::llabs(smoothed - r)) / 4, std::memory_order_relaxed);
+	srtt.store((7 * smoothed + r) / 8, std::memory_order_relaxed);
+}
+
+void HCSTimeoutPolicy::reset()
+{
+	srtt = -1;
+	rttvar = 0;
+}
+
+std::chrono::microseconds HCSTimeoutPolicy::smoothedTurnaround() const
+{
+	return std::chrono::microseconds(srtt.load(std::memory_order_relaxed));
+}
+
+std::chrono::microseconds HCSTimeoutPolicy::turnaroundVariation() const
+{
+	return std::chrono::microseconds(rttvar.load(std::memory_order_relaxed));
+}
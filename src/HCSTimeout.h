@@ -0,0 +1,83 @@
+/*
+ * HCSTimeout.h
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#ifndef HCSTIMEOUT_H_
+#define HCSTIMEOUT_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "Protocol.h"
+
+/**
+ * Response timeouts and retries of one device connection.
+ *
+ * The timeout of a command is the time its bytes need on the wire at the baud rate,
+ * plus the turnaround time of the device. The turnaround is estimated from the
+ * observed round trips like the retransmission timeout of TCP (RFC 6298):
+ *
+ *	SRTT   = 7/8 SRTT + 1/8 R
+ *	RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|
+ *	RTO    = SRTT + max(granularity, 4 RTTVAR)
+ *
+ * Round trips of resent commands are not sampled (Karn). The timeout of a resent
+ * command is doubled with each failure. So a lost response is detected after a
+ * few turnarounds, instead of a fixed two seconds.
+ */
+class HCSTimeoutPolicy {
+public:
+	struct Options {
+		unsigned int tries = 5;										// a command is sent up to tries times
+		std::chrono::microseconds initialTimeout{1000000};			// turnaround, until the first round trip is sampled
+		std::chrono::microseconds minTimeout{20000};
+		std::chrono::microseconds maxTimeout{2000000};
+		std::chrono::microseconds granularity{1000};				// lower bound of the variance term
+		std::chrono::microseconds resendDelay{10000};				// late bytes of a lost response arrive in this break
+		unsigned int bitsPerByte = 10;								// 8N1
+		bool adaptive = true;										// false: initialTimeout is used for every command
+	};
+
+private:
+	unsigned int baud;
+	Options options;
+	std::atomic<int64_t> srtt{-1};		// us, -1 until the first sample
+	std::atomic<int64_t> rttvar{0};		// us
+
+public:
+	explicit HCSTimeoutPolicy(unsigned int _baud) : baud(_baud)
+	{
+	}
+	HCSTimeoutPolicy(unsigned int _baud, Options _options) : baud(_baud)
+	{
+		setOptions(_options);
+	}
+
+	void setOptions(const Options& _options);
+	const Options& getOptions() const;
+	void setBaud(const unsigned int _baud);
+
+	// time to transfer cmd and its response at the baud rate. The command is already
+	// transferred, if it follows the response of a previous command (pipelined)
+	std::chrono::microseconds wireTime(const Protocol::Frame& cmd, const bool followsResponse = false) const;
+	// time to wait for the response of cmd, after it was written failures times before
+	std::chrono::microseconds timeout(const Protocol::Frame& cmd, const unsigned int failures, const bool followsResponse = false) const;
+	std::chrono::microseconds resendDelay() const;
+	unsigned int tries() const;
+
+	// round trip of cmd, from written or the previous response until its response is complete
+	void sample(const Protocol::Frame& cmd, const std::chrono::microseconds roundTrip, const bool followsResponse = false);
+	// forgets the estimate, e.g. if the device was reconnected
+	void reset();
+
+	// estimated turnaround of the device and its variation, -1 without a sample
+	std::chrono::microseconds smoothedTurnaround() const;
+	std::chrono::microseconds turnaroundVariation() const;
+};
+
+#endif /* HCSTIMEOUT_H_ */
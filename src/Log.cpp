@@ -0,0 +1,237 @@
+/*
+ * Log.cpp
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#include "Log.h"
+
+#include <strings.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace Log {
+
+std::atomic<Level> runtimeLevel{Level::WARN};
+
+static const char* LEVEL_NAMES[] = {"trace", "debug", "info", "warn", "error", "off"};
+
+static bool levelFromEnvironment()
+{
+	const char *env = std::getenv("MANSON_LOG_LEVEL");
+	if(env == nullptr){
+		return false;
+	}
+	for(size_t i = 0; i < sizeof(LEVEL_NAMES) / sizeof(LEVEL_NAMES[0]); ++i)
+	{
+		if(strcasecmp(env, LEVEL_NAMES[i]) == 0){
+			runtimeLevel = static_cast<Level>(i);
+			return true;
+		}
+	}
+	return false;
+}
+static const bool environmentApplied = levelFromEnvironment();
+
+/**
+ * Bounded multi producer queue (a slot sequence per record, see D. Vyukov) and the
+ * thread, that drains it. Producers claim a slot with one CAS and never wait.
+ */
+class Sink {
+private:
+	static constexpr size_t QUEUE_SIZE = 1024;	// has to be a power of two
+	static constexpr size_t MASK = QUEUE_SIZE - 1;
+
+	struct Record {
+		std::atomic<size_t> sequence;
+		Level level;
+		uint16_t length;
+		char message[MESSAGE_SIZE];
+	};
+
+	Record records[QUEUE_SIZE];
+	alignas(64) std::atomic<size_t> head{0};	// next slot of the producers
+	alignas(64) std::atomic<size_t> tail{0};	// next slot of the sink thread
+
+	std::atomic<uint64_t> lost{0};
+	std::atomic<int> fd{STDERR_FILENO};
+	std::atomic<bool> sleeping{false};
+	std::mutex sleepMutex;
+	std::condition_variable wakeUp;
+
+	void drain();
+
+public:
+	Sink();
+
+	void push(const Level level, const char *message, const size_t length);
+	void flush();
+
+	void setFd(const int _fd) {
+		fd = _fd;
+	}
+	uint64_t dropped() const {
+		return lost;
+	}
+};
+
+Sink::Sink()
+{
+	for(size_t i = 0; i < QUEUE_SIZE; ++i){
+		records[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	// the sink lives until the process exits, messages of static destructors are still written
+	std::thread(&Sink::drain, this).detach();
+}
+
+static Sink& sink()
+{
+	static Sink *s = [](){
+		Sink *instance = new Sink();
+		std::atexit(flush);
+		return instance;
+	}();
+	return *s;
+}
+
+void Sink::push(const Level level, const char *message, const size_t length)
+{
+	size_t pos = head.load(std::memory_order_relaxed);
+	Record *r;
+
+	for(;;)
+	{
+		r = &records[pos & MASK];
+		const intptr_t diff = static_cast<intptr_t>(r->sequence.load(std::memory_order_acquire)) - static_cast<intptr_t>(pos);
+		if(diff == 0)
+		{
+			if(head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+				break;
+			}
+		}
+		else if(diff < 0)
+		{
+			// the queue is full
+			++lost;
+			return;
+		}
+		else
+		{
+			pos = head.load(std::memory_order_relaxed);
+		}
+	}
+
+	r->level = level;
+	r->length = static_cast<uint16_t>(std::min(length, MESSAGE_SIZE));
+	std::memcpy(r->message, message, r->length);
+	r->sequence.store(pos + 1, std::memory_order_release);
+
+	if(sleeping.load(std::memory_order_acquire)){
+		wakeUp.notify_one();
+	}
+}
+
+/**
+ * Writes the queued messages in chunks with a single write() each
+ */
+void Sink::drain()
+{
+	char out[16 * 1024];
+
+	for(;;)
+	{
+		size_t n = 0;
+		size_t pos = tail.load(std::memory_order_relaxed);
+
+		while(n + MESSAGE_SIZE + 16 < sizeof(out))
+		{
+			Record& r = records[pos & MASK];
+			if(r.sequence.load(std::memory_order_acquire) != pos + 1){
+				break;
+			}
+
+			const char *name = LEVEL_NAMES[static_cast<size_t>(r.level)];
+			n += snprintf(out + n, sizeof(out) - n, "manson %s: ", name);
+			std::memcpy(out + n, r.message, r.length);
+			n += r.length;
+			out[n++] = '\n';
+
+			r.sequence.store(pos + QUEUE_SIZE, std::memory_order_release);
+			++pos;
+		}
+
+		if(n > 0)
+		{
+			for(size_t written = 0; written < n;)
+			{
+				ssize_t ret = ::write(fd, out + written, n - written);
+				if(ret <= 0){
+					break;
+				}
+				written += ret;
+			}
+			tail.store(pos, std::memory_order_release);
+			continue;
+		}
+
+		// a message, that is pushed while falling asleep, is written after the timeout at the latest
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleeping.store(true, std::memory_order_release);
+		wakeUp.wait_for(lock, std::chrono::milliseconds(20));
+		sleeping.store(false, std::memory_order_relaxed);
+	}
+}
+
+void Sink::flush()
+{
+	const size_t end = head.load(std::memory_order_acquire);
+	while(tail.load(std::memory_order_acquire) < end)
+	{
+		wakeUp.notify_one();
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+}
+
+void setLevel(const Level level)
+{
+	runtimeLevel = level;
+}
+
+Level getLevel()
+{
+	return runtimeLevel;
+}
+
+void setSink(const int fd)
+{
+	sink().setFd(fd);
+}
+
+void flush()
+{
+	sink().flush();
+}
+
+uint64_t dropped()
+{
+	return sink().dropped();
+}
+
+void write(const Level level, const char *message, const size_t length)
+{
+	sink().push(level, message, length);
+}
+
+}	// namespace Log
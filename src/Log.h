@@ -0,0 +1,117 @@
+/*
+ * Log.h
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#ifndef LOG_H_
+#define LOG_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <streambuf>
+
+/**
+ * Asynchronous, level gated logging of the library.
+ *
+ * A message is formatted into a fixed buffer on the calling thread and passed to
+ * a sink thread through a lock-free queue. The sink thread writes it to stderr
+ * (see setSink()). A full queue drops messages, it never blocks the caller.
+ *
+ * Levels below __MANSON_LOG_LEVEL are removed at compile time (default INFO,
+ * TRACE with -D__MANSON_DEBUG). The runtime level is WARN, so the library is quiet
+ * by default. It is set with Log::setLevel() or the environment variable
+ * MANSON_LOG_LEVEL (trace, debug, info, warn, error, off).
+ * The arguments of a disabled message are not evaluated.
+ *
+ *	MANSON_LOG_INFO("setting voltage to: <" << voltage << "V>");
+ */
+
+#ifndef __MANSON_LOG_LEVEL
+#ifdef __MANSON_DEBUG
+#define __MANSON_LOG_LEVEL 0
+#else
+#define __MANSON_LOG_LEVEL 2
+#endif
+#endif
+
+namespace Log {
+
+enum class Level : uint8_t {TRACE = 0, DEBUG, INFO, WARN, ERROR, OFF};
+
+static constexpr Level COMPILE_LEVEL = static_cast<Level>(__MANSON_LOG_LEVEL);
+static constexpr size_t MESSAGE_SIZE = 232;	// longer messages are truncated
+
+extern std::atomic<Level> runtimeLevel;
+
+inline bool enabled(const Level level)
+{
+	return level >= runtimeLevel.load(std::memory_order_relaxed);
+}
+
+void setLevel(const Level level);
+Level getLevel();
+
+// file descriptor, the sink thread writes to. The default is stderr
+void setSink(const int fd);
+
+// blocks until all queued messages are written
+void flush();
+
+// number of messages, that were dropped, because the queue was full
+uint64_t dropped();
+
+void write(const Level level, const char *message, const size_t length);
+
+/**
+ * Formats one message into a fixed buffer and queues it, when it is destroyed
+ */
+class Line {
+private:
+	class Buffer : public std::streambuf {
+	public:
+		char data[MESSAGE_SIZE];
+		Buffer() {
+			setp(data, data + sizeof(data));
+		}
+		size_t size() const {
+			return pptr() - pbase();
+		}
+	};
+
+	Level level;
+	Buffer buffer;
+	std::ostream out;
+
+public:
+	explicit Line(const Level _level) : level(_level), out(&buffer) {}
+	~Line() {
+		write(level, buffer.data, buffer.size());
+	}
+
+	std::ostream& stream() {
+		return out;
+	}
+};
+
+}	// namespace Log
+
+#define MANSON_LOG(LEVEL, MESSAGE) \
+	do { \
+		if(Log::Level::LEVEL >= Log::COMPILE_LEVEL && Log::enabled(Log::Level::LEVEL)) { \
+			Log::Line line(Log::Level::LEVEL); \
+			line.stream() << MESSAGE; \
+		} \
+	} while(0)
+
+#define MANSON_LOG_TRACE(MESSAGE) MANSON_LOG(TRACE, MESSAGE)
+#define MANSON_LOG_DEBUG(MESSAGE) MANSON_LOG(DEBUG, MESSAGE)
+#define MANSON_LOG_INFO(MESSAGE) MANSON_LOG(INFO, MESSAGE)
+#define MANSON_LOG_WARN(MESSAGE) MANSON_LOG(WARN, MESSAGE)
+#define MANSON_LOG_ERROR(MESSAGE) MANSON_LOG(ERROR, MESSAGE)
+
+#endif /* LOG_H_ */
@@ -0,0 +1,300 @@
+/*
+ * Protocol.h
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#ifndef PROTOCOL_H_
+#define PROTOCOL_H_
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+/**
+ * UART protocol of the HCS devices.
+ *
+ * A command is a mnemonic, followed by fixed width decimal arguments and "\r\n".
+ * The device replies with responseLength bytes of payload terminated by "\r" and "OK\r".
+ * Every command is described once in COMMANDS, the encoder and the response
+ * handling derive lengths from this table only. The decoders parse a response
+ * in place and return typed values, they do not allocate.
+ */
+namespace Protocol {
+
+enum class Command : uint8_t {GMAX, VOLT, CURR, GETS, GETD, GOVP, SOVP, GOCP, SOCP, GETM, RUNM, PROM};
+
+struct Spec {
+	char mnemonic[5];
+	uint8_t arguments;		// number of arguments
+	uint8_t digits;			// decimal digits of each argument
+	uint8_t responseLength;	// payload bytes of the response, without terminator
+	bool expectOk;
+};
+
+static constexpr Spec COMMANDS[] = {
+	{"GMAX", 0, 0, 6, true},	// VVVCCC
+	{"VOLT", 1, 3, 0, true},
+	{"CURR", 1, 3, 0, true},
+	{"GETS", 0, 0, 6, true},	// VVVCCC
+	{"GETD", 0, 0, 9, true},	// VVVVCCCCS
+	{"GOVP", 0, 0, 3, true},	// VVV
+	{"SOVP", 1, 3, 0, true},
+	{"GOCP", 0, 0, 3, true},	// CCC
+	{"SOCP", 1, 3, 0, true},
+	{"GETM", 0, 0, 20, true},	// 3 x VVVCCC, separated by \r
+	{"RUNM", 1, 1, 0, true},
+	{"PROM", 6, 3, 0, true},	// 3 x VVVCCC
+};
+
+constexpr const Spec& spec(const Command c)
+{
+	return COMMANDS[static_cast<size_t>(c)];
+}
+
+constexpr size_t frameLength(const Command c)
+{
+	return 4 + spec(c).arguments * spec(c).digits + 2;
+}
+
+// bytes of a response with payloadLength bytes of payload on the wire: "<payload>\r" and "OK\r"
+constexpr size_t responseFrameLength(const size_t payloadLength, const bool expectOk)
+{
+	return ((payloadLength > 0) ? payloadLength + 1 : 0) + (expectOk ? 3 : 0);
+}
+
+constexpr size_t responseFrameLength(const Command c)
+{
+	return responseFrameLength(spec(c).responseLength, spec(c).expectOk);
+}
+
+constexpr size_t maxFrameLength()
+{
+	size_t length = 0;
+	for(size_t i = 0; i < sizeof(COMMANDS) / sizeof(COMMANDS[0]); ++i){
+		length = (frameLength(static_cast<Command>(i)) > length) ? frameLength(static_cast<Command>(i)) : length;
+	}
+	return length;
+}
+
+static constexpr size_t MAX_FRAME_LENGTH = maxFrameLength();
+
+/**
+ * An encoded command, ready to be written to the device
+ */
+struct Frame {
+	Command command = Command::GETS;
+	uint8_t length = 0;		// bytes in data, including "\r\n"
+	char data[MAX_FRAME_LENGTH] = {};
+
+	constexpr const Spec& spec() const {
+		return Protocol::spec(command);
+	}
+
+	// the command without "\r\n"
+	constexpr std::string_view text() const {
+		return std::string_view(data, length - 2);
+	}
+};
+
+/**
+ * Formats command C with its arguments into a Frame. The number of arguments is checked
+ * at compile time, their range at run time.
+ *
+ *	Protocol::Frame f = Protocol::encode<Protocol::Command::VOLT>(120);	// "VOLT120\r\n"
+ */
+template<Command C, typename... Values>
+constexpr Frame encode(const Values... values)
+{
+	static_assert(sizeof...(Values) == spec(C).arguments, "wrong number of arguments for command");
+
+	constexpr Spec s = spec(C);
+	const long arguments[sizeof...(Values) + 1] = {static_cast<long>(values)..., 0};
+
+	long limit = 1;
+	for(uint8_t i = 0; i < s.digits; ++i){
+		limit *= 10;
+	}
+
+	Frame f;
+	f.command = C;
+	for(size_t i = 0; i < 4; ++i){
+		f.data[f.length++] = s.mnemonic[i];
+	}
+	for(size_t a = 0; a < sizeof...(Values); ++a)
+	{
+		long v = arguments[a];
+		if(v < 0 || v >= limit){
+			throw std::out_of_range("argument of command is out of range");
+		}
+		for(size_t d = s.digits; d > 0; --d){
+			f.data[f.length + d - 1] = '0' + (v % 10);
+			v /= 10;
+		}
+		f.length += s.digits;
+	}
+	f.data[f.length++] = '\r';
+	f.data[f.length++] = '\n';
+	return f;
+}
+
+/**
+ * Parses the text of a command without "\r\n", e.g. "VOLT120", into a Frame.
+ * returns false, if the mnemonic is unknown or the arguments do not match its spec.
+ */
+constexpr bool decodeCommand(const std::string_view text, Frame& f) noexcept
+{
+	for(size_t i = 0; i < sizeof(COMMANDS) / sizeof(COMMANDS[0]); ++i)
+	{
+		const Command c = static_cast<Command>(i);
+		if(text.substr(0, 4) != std::string_view(COMMANDS[i].mnemonic, 4)){
+			continue;
+		}
+		if(text.length() + 2 != frameLength(c)){
+			return false;
+		}
+		for(size_t d = 4; d < text.length(); ++d)
+		{
+			if(text[d] < '0' || text[d] > '9'){
+				return false;
+			}
+		}
+
+		f.command = c;
+		f.length = 0;
+		for(const char ch : text){
+			f.data[f.length++] = ch;
+		}
+		f.data[f.length++] = '\r';
+		f.data[f.length++] = '\n';
+		return true;
+	}
+	return false;
+}
+
+static_assert(encode<Command::PROM>(0, 0, 0, 0, 0, 0).length == MAX_FRAME_LENGTH, "PROM is the longest command");
+static_assert(encode<Command::VOLT>(123).text() == "VOLT123", "VOLT is encoded with 3 digits");
+
+/**
+ * Scheduling class of a command, see HCSManager. Waiting commands of a higher class
+ * (lower value) are sent first: limits before setpoints before reads.
+ */
+enum class Priority : uint8_t {SAFETY, SETPOINT, TELEMETRY};
+static constexpr size_t PRIORITIES = 3;
+
+constexpr Priority priority(const Command c)
+{
+	switch(c)
+	{
+	case Command::SOVP:
+	case Command::SOCP:
+		return Priority::SAFETY;
+	case Command::VOLT:
+	case Command::CURR:
+	case Command::RUNM:
+	case Command::PROM:
+		return Priority::SETPOINT;
+	default:
+		return Priority::TELEMETRY;
+	}
+}
+
+enum class Mode : uint8_t {UNKNOWN, CV, CC};
+
+// voltage in V, current in A
+struct Values {
+	float voltage;
+	float current;
+};
+
+struct Measurement {
+	float voltage;
+	float current;
+	Mode mode;		// GETD only
+};
+
+// memory presets M0, M1, M2
+struct Presets {
+	Values memory[3];
+};
+
+/**
+ * parses count decimal digits of s, starting at pos. Signs and blanks are rejected.
+ */
+inline bool decodeDigits(const std::string_view s, const size_t pos, const size_t count, int& value) noexcept
+{
+	if(s.length() < pos + count || s[pos] < '0' || s[pos] > '9'){
+		return false;
+	}
+	const char *end = s.data() + pos + count;
+	std::from_chars_result r = std::from_chars(s.data() + pos, end, value);
+	return r.ec == std::errc() && r.ptr == end;
+}
+
+// VVVCCC in 100mV/100mA, the response of GMAX and GETS
+inline bool decodeValues(const std::string_view s, Values& values) noexcept
+{
+	int v, c;
+	if(!decodeDigits(s, 0, 3, v) || !decodeDigits(s, 3, 3, c)){
+		return false;
+	}
+	values = {v / 10.0f, c / 10.0f};
+	return true;
+}
+
+// GETS: the preset voltage and current, the mode is unknown
+inline bool decodeSetpoint(const std::string_view s, Measurement& m) noexcept
+{
+	Values values;
+	if(!decodeValues(s, values)){
+		return false;
+	}
+	m = {values.voltage, values.current, Mode::UNKNOWN};
+	return true;
+}
+
+// GETD: VVVVCCCCS in 10mV/10mA, S is 1 in CC mode
+inline bool decodeDisplay(const std::string_view s, Measurement& m) noexcept
+{
+	int v, c, cc;
+	if(!decodeDigits(s, 0, 4, v) || !decodeDigits(s, 4, 4, c) || !decodeDigits(s, 8, 1, cc)){
+		return false;
+	}
+	m = {v / 100.0f, c / 100.0f, cc ? Mode::CC : Mode::CV};
+	return true;
+}
+
+// GOVP, GOCP: VVV or CCC in 100mV/100mA
+inline bool decodeLimit(const std::string_view s, float& limit) noexcept
+{
+	int l;
+	if(!decodeDigits(s, 0, 3, l)){
+		return false;
+	}
+	limit = l / 10.0f;
+	return true;
+}
+
+// GETM: 3 x VVVCCC, separated by \r
+inline bool decodePresets(const std::string_view s, Presets& presets) noexcept
+{
+	for(size_t i = 0; i < 3; ++i)
+	{
+		const size_t pos = i * 7;
+		if(s.length() < pos + 6 || !decodeValues(s.substr(pos, 6), presets.memory[i])){
+			return false;
+		}
+		if(i < 2 && (s.length() <= pos + 6 || s[pos + 6] != '\r')){
+			return false;
+		}
+	}
+	return true;
+}
+
+}	// namespace Protocol
+
+#endif /* PROTOCOL_H_ */
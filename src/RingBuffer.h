@@ -0,0 +1,150 @@
+/*
+ * RingBuffer.h
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#ifndef RINGBUFFER_H_
+#define RINGBUFFER_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * Lock-free ring buffer with a single producer and any number of consumers.
+ *
+ * Every consumer reads all values with its own Reader. The producer never waits:
+ * if a reader falls behind by more than CAPACITY values, the oldest values are
+ * overwritten and counted as lost by that reader.
+ * A slot is guarded by a sequence number, that is odd while the slot is written.
+ * The value is stored in atomic words, so readers never race with the producer.
+ */
+template<typename T, size_t CAPACITY>
+class RingBuffer {
+	static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY has to be a power of two");
+	static_assert(std::is_trivially_copyable<T>::value, "T has to be trivially copyable");
+
+private:
+	static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	struct Slot {
+		std::atomic<uint64_t> sequence{0};
+		std::array<std::atomic<uint64_t>, WORDS> words{};
+	};
+
+	std::array<Slot, CAPACITY> slots;
+	std::atomic<uint64_t> head{0};	// number of values pushed
+
+	Slot& slot(const uint64_t position) noexcept {
+		return slots[position & (CAPACITY - 1)];
+	}
+
+public:
+	class Reader {
+	private:
+		RingBuffer *ring;
+		uint64_t cursor;
+		uint64_t lostValues = 0;
+
+	public:
+		Reader(RingBuffer& _ring, uint64_t _cursor) : ring(&_ring), cursor(_cursor) {}
+
+		// copies the next value to value. returns false, if there is no new value
+		bool next(T& value) noexcept
+		{
+			while(true)
+			{
+				const uint64_t head = ring->head.load(std::memory_order_acquire);
+				if(cursor >= head){
+					return false;
+				}
+				if(head - cursor > CAPACITY){
+					lostValues += head - cursor - CAPACITY;
+					cursor = head - CAPACITY;
+				}
+
+				if(ring->read(cursor, value)){
+					++cursor;
+					return true;
+				}
+				// the slot was overwritten while it was read, skip to a newer value
+				++lostValues;
+				++cursor;
+			}
+		}
+
+		// number of values, that were overwritten before they were read
+		uint64_t lost() const noexcept {
+			return lostValues;
+		}
+	};
+
+	// only one thread may push
+	void push(const T& value) noexcept
+	{
+		const uint64_t position = head.load(std::memory_order_relaxed);
+		Slot& s = slot(position);
+
+		uint64_t words[WORDS] = {};
+		std::memcpy(words, &value, sizeof(T));
+
+		s.sequence.store(2 * position + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for(size_t i = 0; i < WORDS; ++i){
+			s.words[i].store(words[i], std::memory_order_relaxed);
+		}
+		s.sequence.store(2 * position + 2, std::memory_order_release);
+		head.store(position + 1, std::memory_order_release);
+	}
+
+	// reads the value at position. returns false, if it was overwritten
+	bool read(const uint64_t position, T& value) noexcept
+	{
+		Slot& s = slot(position);
+		uint64_t words[WORDS];
+
+		const uint64_t before = s.sequence.load(std::memory_order_acquire);
+		if(before != 2 * position + 2){
+			return false;
+		}
+		for(size_t i = 0; i < WORDS; ++i){
+			words[i] = s.words[i].load(std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(s.sequence.load(std::memory_order_relaxed) != before){
+			return false;
+		}
+
+		std::memcpy(&value, words, sizeof(T));
+		return true;
+	}
+
+	// a reader, that starts with the next value pushed
+	Reader reader() noexcept {
+		return Reader(*this, head.load(std::memory_order_acquire));
+	}
+
+	// copies the newest value to value. returns false, if there is none
+	bool latest(T& value) noexcept
+	{
+		uint64_t h;
+		while((h = head.load(std::memory_order_acquire)) > 0)
+		{
+			if(read(h - 1, value)){
+				return true;
+			}
+		}
+		return false;
+	}
+
+	uint64_t size() const noexcept {
+		return head.load(std::memory_order_acquire);
+	}
+};
+
+#endif /* RINGBUFFER_H_ */
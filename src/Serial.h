@@ -12,19 +12,50 @@
 #include <cstring>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <linux/serial.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
 #include <string>
 #include <cerrno>
 
+#include "Protocol.h"
+
 class Serial {
 public:
 	// rule of 0
 
+	/**
+	 * Line settings of connect(). The defaults are the classic settings, a tuned connection
+	 * to a USB serial adapter sets lowLatency and a short settle time.
+	 */
+	struct Settings {
+		unsigned int baud = 9600;		// any rate of the driver, rates without a Bxxx constant are set with termios2 (BOTHER)
+		bool lowLatency = false;		// ASYNC_LOW_LATENCY: the driver passes received bytes on at once (FTDI: 1ms latency timer)
+		std::chrono::microseconds settle{10000};	// wait after raising DTR and RTS
+		int latencyTimer = -1;			// reported by query(): latency timer of a USB serial adapter in ms, -1 if unknown
+	};
+
 	static int connect(const char *device, const int baud) {
+		Settings settings;
+		settings.baud = baud;
+		return connect(device, settings);
+	}
+
+	static int connect(const char *device, const Settings& settings) {
 		struct termios options;
 		speed_t myBaud;
 		int status, fd;
 
-		switch (baud) {
+		switch (settings.baud) {
 		case 9600:
 			myBaud = B9600;
 			break;
@@ -41,7 +72,12 @@ public:
 			myBaud = B115200;
 			break;
 		default:
+#ifdef TCGETS2
+			myBaud = B0;	// set with termios2 below
+			break;
+#else
 			throw std::runtime_error("baud not selected");
+#endif
 		}
 
 		if ((fd = open(device, O_RDWR | O_NOCTTY | O_NDELAY | O_NONBLOCK))	== -1)
@@ -50,15 +86,17 @@ public:
 			throw std::runtime_error("open failed for usart: " + msg);
 		}
 
-		fcntl(fd, F_SETFL, O_RDWR);
+		// O_NDELAY is cleared, O_NONBLOCK is kept: the I/O thread waits in poll() only, a read() or write()
+		// must not block it
+		fcntl(fd, F_SETFL, O_RDWR | O_NONBLOCK);
 
 		// Get and modify current options:
 
 		tcgetattr(fd, &options);
 
 		cfmakeraw(&options);
-		cfsetispeed(&options, myBaud);
-		cfsetospeed(&options, myBaud);
+		cfsetispeed(&options, (myBaud != B0) ? myBaud : B9600);
+		cfsetospeed(&options, (myBaud != B0) ? myBaud : B9600);
 
 		options.c_cflag |= (CLOCAL | CREAD);
 		options.c_cflag &= ~PARENB;
@@ -68,10 +106,23 @@ public:
 		options.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG);
 		options.c_oflag &= ~OPOST;
 
+		// reads follow poll() and return what is available, the response timeouts are set by HCSTimeoutPolicy
 		options.c_cc[VMIN] = 0;
-		options.c_cc[VTIME] = 100;	// Ten seconds (100 deciseconds)
+		options.c_cc[VTIME] = 0;
 
-		tcsetattr(fd, TCSANOW, &options);
+		if(tcsetattr(fd, TCSANOW, &options) < 0){
+			fail(fd, "could not configure usart");
+		}
+
+#ifdef TCGETS2
+		if(myBaud == B0 && !setBaud(fd, settings.baud)){
+			fail(fd, "baud <" + std::to_string(settings.baud) + "> is not supported");
+		}
+#endif
+		// not every driver has the flag, e.g. a pseudo terminal. query() reports it
+		if(settings.lowLatency){
+			setLowLatency(fd);
+		}
 
 		ioctl(fd, TIOCMGET, &status);
 
@@ -80,11 +131,45 @@ public:
 
 		ioctl(fd, TIOCMSET, &status);
 
-		usleep(10000);	// 10mS
+		if(settings.settle.count() > 0){
+			usleep(settings.settle.count());
+		}
 
 		return fd;
 	}
 
+	/**
+	 * The settings, that are in effect on fd. settle is not known and left at its default
+	 */
+	static Settings query(const int fd, const char *device)
+	{
+		Settings settings;
+		struct termios options;
+		if(tcgetattr(fd, &options) == 0){
+			settings.baud = toRate(cfgetospeed(&options));
+		}
+#ifdef TCGETS2
+		Termios2 options2;
+		if(ioctl(fd, _IOR('T', 0x2A, Termios2), &options2) == 0){
+			settings.baud = options2.c_ospeed;
+		}
+#endif
+		struct serial_struct serial;
+		settings.lowLatency = (ioctl(fd, TIOCGSERIAL, &serial) == 0) && (serial.flags & ASYNC_LOW_LATENCY);
+
+		// e.g. /sys/class/tty/ttyUSB0/device/latency_timer of ftdi_sio
+		char path[PATH_MAX];
+		if(realpath(device, path) != nullptr)
+		{
+			const std::string name(path);
+			std::ifstream timer("/sys/class/tty/" + name.substr(name.rfind('/') + 1) + "/device/latency_timer");
+			if(!(timer >> settings.latencyTimer)){
+				settings.latencyTimer = -1;
+			}
+		}
+		return settings;
+	}
+
 	static void disconnect(int fd)
 	{
 
@@ -99,14 +184,70 @@ public:
 		tcflush (*fd, TCIOFLUSH);
 	}
 
+	// blocks until all written bytes are transmitted
+	static void drain(const int fd) noexcept
+	{
+		tcdrain(fd);
+	}
+
+	// drops the received bytes, that were not read yet. the output is kept
+	static void discardInput(const int fd) noexcept
+	{
+		tcflush(fd, TCIFLUSH);
+	}
+
 	static int puts(int fd, const char* s) noexcept
 	{
 		return write (fd, s, strlen(s));
 	}
 
+	// writes count buffers with a single system call
+	static ssize_t putv(int fd, const struct iovec* iov, const int count) noexcept
+	{
+		return writev(fd, iov, count);
+	}
+
 
 
-	// function timeout is 10s
+	// blocks until data is available on fd or timeoutMs expired.
+	// returns false on timeout or if poll() was interrupted by a signal
+	static bool waitReadable(const int fd, const int timeoutMs)
+	{
+		struct pollfd pfd = {fd, POLLIN, 0};
+		int ready = poll(&pfd, 1, timeoutMs);
+
+		if(ready < 0)
+		{
+			if(errno == EINTR){
+				return false;
+			}
+			std::string msg = std::string(strerror(errno));
+			throw std::runtime_error("poll failed for usart: " + msg);
+		}
+
+		return (ready > 0) && (pfd.revents & POLLIN);
+	}
+
+	// blocks until fd accepts data or timeoutMs expired.
+	// returns false on timeout or if poll() was interrupted by a signal
+	static bool waitWritable(const int fd, const int timeoutMs)
+	{
+		struct pollfd pfd = {fd, POLLOUT, 0};
+		int ready = poll(&pfd, 1, timeoutMs);
+
+		if(ready < 0)
+		{
+			if(errno == EINTR){
+				return false;
+			}
+			std::string msg = std::string(strerror(errno));
+			throw std::runtime_error("poll failed for usart: " + msg);
+		}
+
+		return (ready > 0) && (pfd.revents & (POLLOUT | POLLERR | POLLHUP));
+	}
+
+	// fd has to be readable, see waitReadable()
 	static int getChar(const int fd)
 	{
 		uint8_t c;
@@ -120,6 +261,204 @@ public:
 		return ((uint8_t)c) & 0xFF ;
 	}
 
+private:
+	static void fail(const int fd, const std::string& what)
+	{
+		std::string msg = std::string(strerror(errno));
+		close(fd);
+		throw std::runtime_error(what + ": " + msg);
+	}
+
+	static unsigned int toRate(const speed_t speed) noexcept
+	{
+		switch (speed) {
+		case B9600: return 9600;
+		case B19200: return 19200;
+		case B38400: return 38400;
+		case B57600: return 57600;
+		case B115200: return 115200;
+		default: return 0;
+		}
+	}
+
+	// the flag is changed without privileges, other fields of serial_struct are kept
+	static bool setLowLatency(const int fd) noexcept
+	{
+		struct serial_struct serial;
+		if(ioctl(fd, TIOCGSERIAL, &serial) < 0){
+			return false;
+		}
+		serial.flags |= ASYNC_LOW_LATENCY;
+		return ioctl(fd, TIOCSSERIAL, &serial) == 0;
+	}
+
+#ifdef TCGETS2
+	// struct termios2 of asm-generic/termbits.h, glibc does not declare it
+	struct Termios2 {
+		tcflag_t c_iflag;
+		tcflag_t c_oflag;
+		tcflag_t c_cflag;
+		tcflag_t c_lflag;
+		cc_t c_line;
+		cc_t c_cc[19];
+		speed_t c_ispeed;
+		speed_t c_ospeed;
+	};
+	static constexpr tcflag_t OTHER_BAUD = 0010000;	// BOTHER: the rate is taken from c_ispeed and c_ospeed
+
+	// sets any baud rate, the driver picks the nearest rate it can generate
+	static bool setBaud(const int fd, const unsigned int baud) noexcept
+	{
+		Termios2 options;
+		if(ioctl(fd, _IOR('T', 0x2A, Termios2), &options) < 0){
+			return false;
+		}
+		options.c_cflag &= ~CBAUD;
+		options.c_cflag |= OTHER_BAUD;
+		options.c_ispeed = baud;
+		options.c_ospeed = baud;
+		return ioctl(fd, _IOW('T', 0x2B, Termios2), &options) == 0;
+	}
+#endif
+};
+
+/**
+ * Receive buffer of one serial connection.
+ *
+ * fill() fetches everything the driver has available with a single read()
+ * into a fixed ring buffer. takeFrame() hands out complete responses, which
+ * are framed by their known payload length:
+ *	<payload>\r OK\r
+ * After a framing error, resync() drops the bytes up to the next "OK\r", the
+ * end of a response. The responses, that follow it, are kept.
+ */
+class SerialReader {
+public:
+	static constexpr size_t CAPACITY = 256;
+
+	enum class Frame {INCOMPLETE, COMPLETE, MALFORMED};
+
+	// reads all available bytes from source (a Transport) with one syscall.
+	// returns the number of bytes read, 0 if the buffer is full or -1 on error
+	template<typename Source>
+	ssize_t fill(Source& source) noexcept
+	{
+		const size_t space = CAPACITY - count;
+		if(space == 0){
+			return 0;
+		}
+
+		const size_t tail = (head + count) % CAPACITY;
+		const size_t first = std::min(space, CAPACITY - tail);
+		struct iovec iov[2] = {
+				{&buffer[tail], first},
+				{&buffer[0], space - first}
+		};
+
+		ssize_t n = source.read(iov, (space > first) ? 2 : 1);
+		if(n > 0){
+			count += n;
+		}
+		return n;
+	}
+
+	// checks the buffer for a response with payloadLength bytes, followed by \r
+	// and "OK\r" if expectOk is set. a complete payload is copied to payload.
+	// MALFORMED is returned as soon as a terminator does not match
+	Frame takeFrame(const size_t payloadLength, const bool expectOk, char * const payload) noexcept
+	{
+		if(hunting){
+			return Frame::INCOMPLETE;
+		}
+
+		const size_t okOffset = (payloadLength > 0) ? payloadLength + 1 : 0;
+		const size_t frameLength = Protocol::responseFrameLength(payloadLength, expectOk);
+
+		if(payloadLength > 0 && !matches(payloadLength, '\r')){
+			return Frame::MALFORMED;
+		}
+		if(expectOk && !(matches(okOffset, 'O') && matches(okOffset + 1, 'K') && matches(okOffset + 2, '\r'))){
+			return Frame::MALFORMED;
+		}
+		if(count < frameLength){
+			return Frame::INCOMPLETE;
+		}
+
+		for(size_t i = 0; i < payloadLength; ++i){
+			payload[i] = at(i);
+		}
+		consume(frameLength);
+		return Frame::COMPLETE;
+	}
+
+	size_t available() const noexcept {
+		return count;
+	}
+
+	void clear() noexcept {
+		head = 0;
+		count = 0;
+		hunting = false;
+	}
+
+	// drops the bytes up to and including the next "OK\r". A response, whose "OK" is
+	// corrupted, ends after frameLength bytes. If neither was received yet, the search
+	// is continued by skip() after the next fill(). returns the number of dropped bytes
+	size_t resync(const size_t frameLength = CAPACITY) noexcept {
+		hunting = true;
+		limit = frameLength;
+		return skip();
+	}
+
+	// continues the search of resync(). returns the number of dropped bytes
+	size_t skip() noexcept {
+		const size_t before = count;
+		while(hunting && limit > 0 && count > 0)
+		{
+			if(limit >= 3 && count >= 3 && at(0) == 'O' && at(1) == 'K' && at(2) == '\r')
+			{
+				consume(3);
+				hunting = false;
+			}
+			else if(limit < 3 || count >= 3)
+			{
+				consume(1);
+				--limit;
+			}
+			else
+			{
+				break;	// "OK\r" may be incomplete
+			}
+		}
+		hunting &= (limit > 0);
+		return before - count;
+	}
+
+	// true, while resync() has not found the end of a response
+	bool resyncing() const noexcept {
+		return hunting;
+	}
+
+private:
+	std::array<char, CAPACITY> buffer;
+	size_t head = 0;
+	size_t count = 0;
+	bool hunting = false;
+	size_t limit = 0;	// bytes, that resync() may still drop
+
+	char at(const size_t i) const noexcept {
+		return buffer[(head + i) % CAPACITY];
+	}
+
+	// a byte that has not been received yet, can not mismatch
+	bool matches(const size_t i, const char expected) const noexcept {
+		return (i >= count) || (at(i) == expected);
+	}
+
+	void consume(const size_t n) noexcept {
+		head = (head + n) % CAPACITY;
+		count -= n;
+	}
 };
 
 #endif /* SERIAL_H_ */
@@ -0,0 +1,259 @@
+/*
+ * TelemetryRecorder.cpp
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#include "TelemetryRecorder.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+static constexpr char TELEMETRY_MAGIC[8] = {'M', 'A', 'N', 'S', 'O', 'N', 'T', 'L'};
+static constexpr uint32_t TELEMETRY_VERSION = 1;
+
+static uint16_t toCentiUnits(const float value)
+{
+	if(value <= 0.0f){
+		return 0;
+	}
+	return static_cast<uint16_t>(std::min(std::lround(value * 100.0f), static_cast<long>(UINT16_MAX)));
+}
+
+TelemetryRecorder::TelemetryRecorder(const std::string& _path) : path(_path)
+{
+	if((fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+	{
+		std::string msg = std::string(strerror(errno));
+		throw std::runtime_error("could not create telemetry file <" + path + ">: " + msg);
+	}
+
+	grow();
+
+	TelemetryHeader *h = header();
+	std::memcpy(h->magic, TELEMETRY_MAGIC, sizeof(h->magic));
+	h->version = TELEMETRY_VERSION;
+	h->recordSize = sizeof(TelemetryRecord);
+	h->recordCount = 0;
+	h->created = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+TelemetryRecorder::~TelemetryRecorder()
+{
+	try{
+		close();
+	}catch (std::runtime_error&) {
+		// the file is left with its chunk padding, the header is valid
+	}
+}
+
+TelemetryHeader* TelemetryRecorder::header()
+{
+	return reinterpret_cast<TelemetryHeader*>(mapping);
+}
+
+/**
+ * Extends the file and its mapping by one chunk
+ */
+void TelemetryRecorder::grow()
+{
+	const size_t size = mappedSize + CHUNK_SIZE;
+
+	if(ftruncate(fd, size) < 0)
+	{
+		std::string msg = std::string(strerror(errno));
+		throw std::runtime_error("could not extend telemetry file <" + path + ">: " + msg);
+	}
+
+	void *m = (mapping == nullptr)
+			? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+			: mremap(mapping, mappedSize, size, MREMAP_MAYMOVE);
+	if(m == MAP_FAILED)
+	{
+		std::string msg = std::string(strerror(errno));
+		throw std::runtime_error("could not map telemetry file <" + path + ">: " + msg);
+	}
+
+	mapping = static_cast<uint8_t*>(m);
+	mappedSize = size;
+}
+
+void TelemetryRecorder::append(const HCSSample& sample)
+{
+	if(mapping == nullptr){
+		throw std::runtime_error("telemetry file <" + path + "> is closed");
+	}
+
+	const size_t offset = sizeof(TelemetryHeader) + count * sizeof(TelemetryRecord);
+	if(offset + sizeof(TelemetryRecord) > mappedSize){
+		grow();
+	}
+
+	TelemetryRecord *r = reinterpret_cast<TelemetryRecord*>(mapping + offset);
+	r->timestamp = sample.timestamp;
+	r->voltage = toCentiUnits(sample.voltage);
+	r->current = toCentiUnits(sample.current);
+	r->mode = static_cast<uint8_t>(sample.mode);
+	r->source = static_cast<uint8_t>(sample.source);
+	r->reserved[0] = r->reserved[1] = 0;
+
+	header()->recordCount = ++count;
+}
+
+/**
+ * Appends all samples, that are available in reader. returns the number of samples
+ */
+size_t TelemetryRecorder::drain(HCSSampler::Ring::Reader& reader)
+{
+	HCSSample sample;
+	size_t n = 0;
+
+	while(reader.next(sample)){
+		append(sample);
+		++n;
+	}
+	return n;
+}
+
+void TelemetryRecorder::start(HCSSampler& sampler, std::chrono::milliseconds period)
+{
+	if(running.exchange(true)){
+		throw std::runtime_error("telemetry recorder for <" + path + "> is already running");
+	}
+
+	worker = std::thread([this, &sampler, period](){
+		HCSSampler::Ring::Reader reader = sampler.reader();
+		auto next = std::chrono::steady_clock::now();
+		while(running)
+		{
+			drain(reader);
+			next += period;
+			std::this_thread::sleep_until(next);
+		}
+		drain(reader);
+	});
+}
+
+void TelemetryRecorder::stop()
+{
+	if(worker.joinable()){
+		running = false;
+		worker.join();
+	}
+}
+
+/**
+ * Stops recording and truncates the file to the records written
+ */
+void TelemetryRecorder::close()
+{
+	stop();
+
+	if(mapping == nullptr){
+		return;
+	}
+
+	const size_t size = sizeof(TelemetryHeader) + count * sizeof(TelemetryRecord);
+	msync(mapping, mappedSize, MS_SYNC);
+	munmap(mapping, mappedSize);
+	mapping = nullptr;
+	mappedSize = 0;
+
+	const bool truncated = (ftruncate(fd, size) == 0);
+	::close(fd);
+	fd = -1;
+
+	if(!truncated){
+		throw std::runtime_error("could not truncate telemetry file <" + path + ">");
+	}
+}
+
+uint64_t TelemetryRecorder::size() const
+{
+	return count;
+}
+
+TelemetryReader::TelemetryReader(const std::string& path)
+{
+	struct stat st;
+
+	if((fd = open(path.c_str(), O_RDONLY)) < 0 || fstat(fd, &st) < 0)
+	{
+		std::string msg = std::string(strerror(errno));
+		if(fd >= 0){
+			::close(fd);
+		}
+		throw std::runtime_error("could not open telemetry file <" + path + ">: " + msg);
+	}
+
+	mappedSize = st.st_size;
+	if(mappedSize < sizeof(TelemetryHeader))
+	{
+		::close(fd);
+		throw std::runtime_error("telemetry file <" + path + "> is too short");
+	}
+
+	void *m = mmap(nullptr, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+	if(m == MAP_FAILED)
+	{
+		std::string msg = std::string(strerror(errno));
+		::close(fd);
+		throw std::runtime_error("could not map telemetry file <" + path + ">: " + msg);
+	}
+	mapping = static_cast<const uint8_t*>(m);
+
+	const TelemetryHeader& h = header();
+	if(std::memcmp(h.magic, TELEMETRY_MAGIC, sizeof(h.magic)) != 0 || h.version != TELEMETRY_VERSION || h.recordSize != sizeof(TelemetryRecord))
+	{
+		munmap(const_cast<uint8_t*>(mapping), mappedSize);
+		::close(fd);
+		throw std::runtime_error("<" + path + "> is not a telemetry file of version " + std::to_string(TELEMETRY_VERSION));
+	}
+
+	// a file of a process, that died, still has its chunk padding
+	count = std::min<uint64_t>(h.recordCount, (mappedSize - sizeof(TelemetryHeader)) / sizeof(TelemetryRecord));
+}
+
+TelemetryReader::~TelemetryReader()
+{
+	munmap(const_cast<uint8_t*>(mapping), mappedSize);
+	::close(fd);
+}
+
+const TelemetryHeader& TelemetryReader::header() const
+{
+	return *reinterpret_cast<const TelemetryHeader*>(mapping);
+}
+
+uint64_t TelemetryReader::size() const
+{
+	return count;
+}
+
+const TelemetryRecord& TelemetryReader::operator[](uint64_t i) const
+{
+	if(i >= count){
+		throw std::out_of_range("telemetry record <" + std::to_string(i) + "> does not exist");
+	}
+	return begin()[i];
+}
+
+const TelemetryRecord* TelemetryReader::begin() const
+{
+	return reinterpret_cast<const TelemetryRecord*>(mapping + sizeof(TelemetryHeader));
+}
+
+const TelemetryRecord* TelemetryReader::end() const
+{
+	return begin() + count;
+}
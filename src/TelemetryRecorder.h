@@ -0,0 +1,123 @@
+/*
+ * TelemetryRecorder.h
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#ifndef TELEMETRYRECORDER_H_
+#define TELEMETRYRECORDER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "HCSSampler.h"
+
+/**
+ * Binary telemetry file:
+ *	TelemetryHeader, followed by recordCount records of recordSize bytes.
+ * All values are stored in host byte order.
+ */
+struct TelemetryHeader {
+	char magic[8];			// "MANSONTL"
+	uint32_t version;
+	uint32_t recordSize;
+	uint64_t recordCount;
+	int64_t created;		// system_clock in ns, when the file was created
+	uint8_t reserved[32];
+};
+static_assert(sizeof(TelemetryHeader) == 64, "TelemetryHeader has to be 64 bytes");
+
+struct TelemetryRecord {
+	int64_t timestamp;		// steady_clock in ns
+	uint16_t voltage;		// 10mV
+	uint16_t current;		// 10mA
+	uint8_t mode;			// HCSSample::Mode
+	uint8_t source;			// HCSSample::Source
+	uint8_t reserved[2];
+
+	float getVoltage() const {
+		return voltage / 100.0f;
+	}
+
+	float getCurrent() const {
+		return current / 100.0f;
+	}
+};
+static_assert(sizeof(TelemetryRecord) == 16, "TelemetryRecord has to be 16 bytes");
+
+/**
+ * Appends records to a memory-mapped file. The file grows in chunks, records are
+ * written directly to the mapping. The record count in the header is updated with
+ * every record, so a file stays readable, if the process dies.
+ *
+ * The recorder can drain a HCSSampler on its own thread, see start().
+ */
+class TelemetryRecorder {
+public:
+	static constexpr size_t CHUNK_SIZE = 1 << 20;	// bytes the file grows by
+
+private:
+	std::string path;
+	int fd = -1;
+	uint8_t *mapping = nullptr;
+	size_t mappedSize = 0;
+	uint64_t count = 0;
+
+	std::thread worker;
+	std::atomic<bool> running{false};
+
+	TelemetryHeader* header();
+	void grow();
+
+	TelemetryRecorder(const TelemetryRecorder &other) = delete;
+	TelemetryRecorder(TelemetryRecorder &&other) = delete;
+	TelemetryRecorder& operator=(const TelemetryRecorder &other) = delete;
+	TelemetryRecorder& operator=(TelemetryRecorder &&other) = delete;
+
+public:
+	// creates the file, an existing file is overwritten
+	explicit TelemetryRecorder(const std::string& _path);
+	virtual ~TelemetryRecorder();
+
+	void append(const HCSSample& sample);
+	size_t drain(HCSSampler::Ring::Reader& reader);
+
+	// drains sampler every period on a thread, until stop() is called
+	void start(HCSSampler& sampler, std::chrono::milliseconds period = std::chrono::milliseconds(100));
+	void stop();
+
+	void close();
+	uint64_t size() const;
+};
+
+/**
+ * Maps a telemetry file read-only
+ */
+class TelemetryReader {
+private:
+	int fd = -1;
+	const uint8_t *mapping = nullptr;
+	size_t mappedSize = 0;
+	uint64_t count = 0;
+
+	TelemetryReader(const TelemetryReader &other) = delete;
+	TelemetryReader& operator=(const TelemetryReader &other) = delete;
+
+public:
+	explicit TelemetryReader(const std::string& path);
+	virtual ~TelemetryReader();
+
+	const TelemetryHeader& header() const;
+	uint64_t size() const;
+	const TelemetryRecord& operator[](uint64_t i) const;
+
+	const TelemetryRecord* begin() const;
+	const TelemetryRecord* end() const;
+};
+
+#endif /* TELEMETRYRECORDER_H_ */
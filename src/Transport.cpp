@@ -0,0 +1,331 @@
+/*
+ * Transport.cpp
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#include "Transport.h"
+#include "Log.h"
+#include "Serial.h"
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+FdTransport::~FdTransport()
+{
+	if(fd >= 0){
+		::close(fd);
+	}
+}
+
+void FdTransport::fail(const std::string& what)
+{
+	std::string msg = std::string(strerror(errno));
+	if(fd >= 0){
+		::close(fd);
+		fd = -1;
+	}
+	throw std::runtime_error(what + " <" + path + ">: " + msg);
+}
+
+void FdTransport::close()
+{
+	if(fd < 0){
+		return;
+	}
+	const int f = fd;
+	fd = -1;
+	Serial::disconnect(f);
+}
+
+bool FdTransport::isOpen() const
+{
+	return fd >= 0;
+}
+
+int FdTransport::descriptor() const
+{
+	return fd;
+}
+
+ssize_t FdTransport::write(const struct iovec *iov, const int count) noexcept
+{
+	return Serial::putv(fd, iov, count);
+}
+
+ssize_t FdTransport::read(const struct iovec *iov, const int count) noexcept
+{
+	return ::readv(fd, iov, count);
+}
+
+size_t FdTransport::available() const noexcept
+{
+	int n = 0;
+	return (ioctl(fd, FIONREAD, &n) < 0) ? 0 : n;
+}
+
+/**
+ * A terminal drops its input queue with tcflush(), other descriptors are read empty
+ */
+size_t FdTransport::discard() noexcept
+{
+	size_t n = available();
+
+	if(isatty(fd))
+	{
+		Serial::discardInput(fd);
+		return n;
+	}
+
+	char buf[256];
+	for(size_t left = n; left > 0;)
+	{
+		const ssize_t r = ::recv(fd, buf, std::min(left, sizeof(buf)), MSG_DONTWAIT);
+		if(r <= 0){
+			break;
+		}
+		left -= r;
+	}
+	return n;
+}
+
+void FdTransport::drain() noexcept
+{
+	if(isatty(fd)){
+		Serial::drain(fd);
+	}
+}
+
+std::string FdTransport::name() const
+{
+	return path;
+}
+
+void SerialTransport::open()
+{
+	if(fd >= 0){
+		return;
+	}
+	fd = Serial::connect(path.data(), requested);
+
+	effective = Serial::query(fd, path.c_str());
+	effective.settle = requested.settle;
+	MANSON_LOG_INFO("serial <" << path << "> baud <" << effective.baud << "> low latency <" << (effective.lowLatency ? "on" : "off")
+			<< "> latency timer <" << effective.latencyTimer << " ms> settle <" << effective.settle.count() << " us>");
+	if(requested.lowLatency && !effective.lowLatency){
+		MANSON_LOG_WARN("driver of <" << path << "> does not support low latency mode");
+	}
+}
+
+unsigned int SerialTransport::baud() const
+{
+	return requested.baud;
+}
+
+void PtyTransport::open()
+{
+	if(fd >= 0){
+		return;
+	}
+	if((fd = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC)) < 0){
+		fail("open failed for pseudo terminal");
+	}
+
+	struct termios options;
+	if(tcgetattr(fd, &options) < 0){
+		fail("not a terminal");
+	}
+	cfmakeraw(&options);
+	options.c_cflag |= (CLOCAL | CREAD);
+	options.c_cc[VMIN] = 0;
+	options.c_cc[VTIME] = 0;
+	if(tcsetattr(fd, TCSANOW, &options) < 0){
+		fail("could not configure pseudo terminal");
+	}
+}
+
+void UnixSocketTransport::open()
+{
+	if(fd >= 0){
+		return;
+	}
+
+	struct sockaddr_un address = {};
+	if(path.length() >= sizeof(address.sun_path)){
+		throw std::runtime_error("socket path is too long <" + path + ">");
+	}
+	address.sun_family = AF_UNIX;
+	std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+	if((fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0){
+		fail("could not create socket for");
+	}
+	if(::connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0){
+		fail("could not connect to socket");
+	}
+}
+
+// the peer may close the socket, this must not raise SIGPIPE
+ssize_t UnixSocketTransport::write(const struct iovec *iov, const int count) noexcept
+{
+	struct msghdr msg = {};
+	msg.msg_iov = const_cast<struct iovec*>(iov);
+	msg.msg_iovlen = count;
+	return ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+}
+
+// a closed connection is an error, not an empty read
+ssize_t UnixSocketTransport::read(const struct iovec *iov, const int count) noexcept
+{
+	const ssize_t n = FdTransport::read(iov, count);
+	if(n == 0 && count > 0 && iov[0].iov_len > 0){
+		errno = ECONNRESET;
+		return -1;
+	}
+	return n;
+}
+
+unsigned int UnixSocketTransport::baud() const
+{
+	return bitRate;
+}
+
+LoopbackTransport::~LoopbackTransport()
+{
+	close();
+}
+
+void LoopbackTransport::open()
+{
+	if(event >= 0){
+		return;
+	}
+	if((event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+	{
+		std::string msg = std::string(strerror(errno));
+		throw std::runtime_error("could not create eventfd for loopback: " + msg);
+	}
+	command.clear();
+	discard();
+}
+
+void LoopbackTransport::close()
+{
+	if(event >= 0){
+		::close(event);
+		event = -1;
+	}
+}
+
+bool LoopbackTransport::isOpen() const
+{
+	return event >= 0;
+}
+
+int LoopbackTransport::descriptor() const
+{
+	return event;
+}
+
+/**
+ * The eventfd is readable, as long as there are replies to read
+ */
+void LoopbackTransport::signal(const bool readable) noexcept
+{
+	uint64_t value = 1;
+	ssize_t ret = readable ? ::write(event, &value, sizeof(value)) : ::read(event, &value, sizeof(value));
+	(void)ret;
+}
+
+ssize_t LoopbackTransport::write(const struct iovec *iov, const int count) noexcept
+{
+	if(event < 0){
+		errno = EBADF;
+		return -1;
+	}
+
+	const bool wasEmpty = (available() == 0);
+	ssize_t n = 0;
+	try{
+		for(int i = 0; i < count; ++i)
+		{
+			const char *data = static_cast<const char*>(iov[i].iov_base);
+			for(size_t j = 0; j < iov[i].iov_len; ++j)
+			{
+				if(data[j] == '\r'){
+					input += responder(command);
+					command.clear();
+				}else if(data[j] != '\n'){
+					command += data[j];
+				}
+			}
+			n += iov[i].iov_len;
+		}
+	}catch (...) {
+		errno = EIO;
+		return -1;
+	}
+
+	if(wasEmpty && available() > 0){
+		signal(true);
+	}
+	return n;
+}
+
+ssize_t LoopbackTransport::read(const struct iovec *iov, const int count) noexcept
+{
+	if(event < 0){
+		errno = EBADF;
+		return -1;
+	}
+
+	ssize_t n = 0;
+	for(int i = 0; i < count && available() > 0; ++i)
+	{
+		const size_t length = std::min(iov[i].iov_len, available());
+		std::memcpy(iov[i].iov_base, input.data() + consumed, length);
+		consumed += length;
+		n += length;
+	}
+
+	if(n > 0 && available() == 0)
+	{
+		input.clear();
+		consumed = 0;
+		signal(false);
+	}
+	return n;
+}
+
+size_t LoopbackTransport::available() const noexcept
+{
+	return input.length() - consumed;
+}
+
+size_t LoopbackTransport::discard() noexcept
+{
+	const size_t n = available();
+	if(n > 0 && event >= 0){
+		signal(false);
+	}
+	input.clear();
+	consumed = 0;
+	return n;
+}
+
+std::string LoopbackTransport::name() const
+{
+	return "loopback";
+}
@@ -0,0 +1,177 @@
+/*
+ * Transport.h
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ */
+
+#ifndef TRANSPORT_H_
+#define TRANSPORT_H_
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <functional>
+#include <string>
+
+#include "Serial.h"
+
+/**
+ * Byte stream to a device. HCS runs the protocol over any transport:
+ *
+ *	SerialTransport		USB serial device, configured with termios
+ *	PtyTransport		pseudo terminal, e.g. HCSSimulator or socat
+ *	UnixSocketTransport	stream socket, e.g. a serial server on another host, forwarded by socat or ssh
+ *	LoopbackTransport	in memory, the commands are answered by a function on the calling thread
+ *
+ * Every transport provides a descriptor for poll(), so devices on different transports
+ * can be serviced by one HCSManager.
+ */
+class Transport {
+public:
+	Transport() = default;
+	virtual ~Transport() = default;
+
+	virtual void open() = 0;
+	virtual void close() = 0;
+	virtual bool isOpen() const = 0;
+
+	// poll() reports POLLIN on it, when data can be read
+	virtual int descriptor() const = 0;
+
+	// like writev() and readv(), they do not block
+	virtual ssize_t write(const struct iovec *iov, const int count) noexcept = 0;
+	virtual ssize_t read(const struct iovec *iov, const int count) noexcept = 0;
+
+	// bytes received, that were not read yet
+	virtual size_t available() const noexcept = 0;
+	// drops the received bytes, that were not read yet. returns their number
+	virtual size_t discard() noexcept = 0;
+	// blocks until the written bytes are sent. Only a terminal has an output queue
+	virtual void drain() noexcept {}
+
+	virtual std::string name() const = 0;
+	// bit rate of the link, 0 if the transfer time can be neglected
+	virtual unsigned int baud() const {
+		return 0;
+	}
+
+private:
+	Transport(const Transport &other) = delete;
+	Transport(Transport &&other) = delete;
+	Transport& operator=(const Transport &other) = delete;
+	Transport& operator=(Transport &&other) = delete;
+};
+
+/**
+ * A transport on a file descriptor
+ */
+class FdTransport : public Transport {
+protected:
+	std::string path;
+	int fd = -1;
+
+	// throws with the errno of the failed call
+	[[noreturn]] void fail(const std::string& what);
+
+public:
+	explicit FdTransport(std::string _path) : path(_path) {}
+	virtual ~FdTransport();
+
+	void close() override;
+	bool isOpen() const override;
+	int descriptor() const override;
+	ssize_t write(const struct iovec *iov, const int count) noexcept override;
+	ssize_t read(const struct iovec *iov, const int count) noexcept override;
+	size_t available() const noexcept override;
+	size_t discard() noexcept override;
+	void drain() noexcept override;
+	std::string name() const override;
+};
+
+class SerialTransport : public FdTransport {
+private:
+	Serial::Settings requested;
+	Serial::Settings effective;
+
+public:
+	SerialTransport(std::string device, unsigned int _baud) : FdTransport(device) {
+		requested.baud = _baud;
+	}
+	// tuned line settings, e.g. low latency and a non standard baud rate, see Serial::Settings
+	SerialTransport(std::string device, Serial::Settings _settings) : FdTransport(device), requested(_settings) {}
+
+	void open() override;
+	unsigned int baud() const override;
+
+	// the settings in effect, read back from the driver by open()
+	const Serial::Settings& settings() const {
+		return effective;
+	}
+};
+
+/**
+ * A pseudo terminal in raw mode. There is no baud rate and no modem lines
+ */
+class PtyTransport : public FdTransport {
+public:
+	explicit PtyTransport(std::string device) : FdTransport(device) {}
+
+	void open() override;
+};
+
+class UnixSocketTransport : public FdTransport {
+private:
+	unsigned int bitRate;
+
+public:
+	// baud is the rate of the serial line behind the socket, if the device is forwarded
+	explicit UnixSocketTransport(std::string socketPath, unsigned int _baud = 0) : FdTransport(socketPath), bitRate(_baud) {}
+
+	void open() override;
+	ssize_t write(const struct iovec *iov, const int count) noexcept override;
+	ssize_t read(const struct iovec *iov, const int count) noexcept override;
+	unsigned int baud() const override;
+};
+
+/**
+ * Answers each command ("...\r\n") synchronously with the reply of the responder, e.g.
+ * HCSSimulator::respond(). There is no system call on the command path, except for
+ * the eventfd, that signals the reply to poll().
+ *
+ *	HCSSimulator::Options o;
+ *	o.terminal = false;
+ *	HCSSimulator simulator(o);
+ *	HCS h(std::unique_ptr<Transport>(new LoopbackTransport([&simulator](const std::string& cmd){ return simulator.respond(cmd); })));
+ */
+class LoopbackTransport : public Transport {
+public:
+	// returns the complete reply to a command without "\r\n", an empty reply is not sent
+	using Responder = std::function<std::string(const std::string& command)>;
+
+private:
+	Responder responder;
+	std::string command;	// bytes of an incomplete command
+	std::string input;		// replies, that are not read yet
+	size_t consumed = 0;	// bytes of input, that were read
+	int event = -1;
+
+	void signal(const bool readable) noexcept;
+
+public:
+	explicit LoopbackTransport(Responder _responder) : responder(std::move(_responder)) {}
+	virtual ~LoopbackTransport();
+
+	void open() override;
+	void close() override;
+	bool isOpen() const override;
+	int descriptor() const override;
+	ssize_t write(const struct iovec *iov, const int count) noexcept override;
+	ssize_t read(const struct iovec *iov, const int count) noexcept override;
+	size_t available() const noexcept override;
+	size_t discard() noexcept override;
+	std::string name() const override;
+};
+
+#endif /* TRANSPORT_H_ */
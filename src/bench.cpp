@@ -0,0 +1,298 @@
+/*
+ * bench.cpp
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ *  Round trip latency and throughput benchmark.
+ *  Every UART command is measured on its own, in batches and on multiple devices.
+ *  The library talks to HCSSimulator instances or to the given devices (any PTY)
+ *  as it would talk to /dev/ttyUSBx.
+ *
+ *  usage: manson-bench [options]
+ *	-n <iterations>		operations per benchmark (default 200)
+ *	-d <device>			benchmark device, can be repeated. Simulators are used, if it is not set
+ *	-s <count>			number of simulators (default 4)
+ *	-b <baud>			baud rate (default 9600)
+ *	-l <us>				reply latency of the simulators (default 0)
+ *	-p					pace the simulators at the baud rate
+ *	-r <rate>			reply drop rate of the simulators (default 0)
+ *	-g <rate>			rate of replies with a corrupted byte (default 0)
+ *	-t <transport>		transport to the simulators: pty (default) or loopback (in memory, no latency or pacing)
+ *	-j					print JSON instead of a table
+ *	-m					print the metrics of each device (see HCSMetrics)
+ */
+
+#include "HCS.h"
+#include "HCSManager.h"
+#include "HCSSimulator.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Result {
+	std::string scenario;
+	std::string command;
+	size_t devices;
+	unsigned int commandsPerOperation;
+	std::vector<double> latencies;	// us per operation
+	unsigned int errors = 0;
+	double elapsed = 0.0;			// s
+};
+
+static double percentile(const std::vector<double>& sorted, unsigned int p)
+{
+	if(sorted.empty()){
+		return 0.0;
+	}
+	return sorted[std::min(sorted.size() - 1, (sorted.size() * p) / 100)];
+}
+
+static Result measure(const std::string& scenario, const std::string& command, size_t devices,
+		unsigned int commandsPerOperation, int iterations, const std::function<void(int)>& operation)
+{
+	Result r{scenario, command, devices, commandsPerOperation, {}};
+	r.latencies.reserve(iterations);
+
+	const auto begin = std::chrono::steady_clock::now();
+	for(int i = 0; i < iterations; ++i)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		try{
+			operation(i);
+		}catch (std::exception&) {
+			++r.errors;
+			continue;
+		}
+		const auto end = std::chrono::steady_clock::now();
+		r.latencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+	}
+	r.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	std::sort(r.latencies.begin(), r.latencies.end());
+	return r;
+}
+
+static void printTable(const std::vector<Result>& results)
+{
+	std::cout << std::left << std::setw(10) << "scenario" << std::setw(20) << "command" << std::right
+			<< std::setw(8) << "devices" << std::setw(8) << "ops" << std::setw(8) << "errors"
+			<< std::setw(11) << "p50[us]" << std::setw(11) << "p99[us]" << std::setw(11) << "max[us]"
+			<< std::setw(12) << "cmd/s" << '\n';
+
+	std::cout << std::fixed << std::setprecision(1);
+	for(const Result& r : results)
+	{
+		std::cout << std::left << std::setw(10) << r.scenario << std::setw(20) << r.command << std::right
+				<< std::setw(8) << r.devices << std::setw(8) << r.latencies.size() << std::setw(8) << r.errors
+				<< std::setw(11) << percentile(r.latencies, 50) << std::setw(11) << percentile(r.latencies, 99)
+				<< std::setw(11) << (r.latencies.empty() ? 0.0 : r.latencies.back())
+				<< std::setw(12) << r.latencies.size() * r.commandsPerOperation / r.elapsed << '\n';
+	}
+}
+
+static void printJson(const std::vector<Result>& results, unsigned int baud, bool simulated, const std::vector<std::string>& metrics)
+{
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "{\"baud\":" << baud << ",\"simulated\":" << (simulated ? "true" : "false") << ",\"results\":[";
+	for(size_t i = 0; i < results.size(); ++i)
+	{
+		const Result& r = results[i];
+		double sum = 0.0;
+		for(double l : r.latencies){
+			sum += l;
+		}
+		std::cout << (i ? "," : "") << "\n{\"scenario\":\"" << r.scenario << "\",\"command\":\"" << r.command
+				<< "\",\"devices\":" << r.devices << ",\"commands_per_operation\":" << r.commandsPerOperation
+				<< ",\"operations\":" << r.latencies.size() << ",\"errors\":" << r.errors
+				<< ",\"mean_us\":" << (r.latencies.empty() ? 0.0 : sum / r.latencies.size())
+				<< ",\"p50_us\":" << percentile(r.latencies, 50) << ",\"p99_us\":" << percentile(r.latencies, 99)
+				<< ",\"max_us\":" << (r.latencies.empty() ? 0.0 : r.latencies.back())
+				<< ",\"commands_per_s\":" << r.latencies.size() * r.commandsPerOperation / r.elapsed << "}";
+	}
+	std::cout << "\n]";
+	if(!metrics.empty())
+	{
+		std::cout << ",\"metrics\":[";
+		for(size_t i = 0; i < metrics.size(); ++i){
+			std::cout << (i ? "," : "") << "\n" << metrics[i];
+		}
+		std::cout << "\n]";
+	}
+	std::cout << "}\n";
+}
+
+int main(int argc, char **argv) {
+	int iterations = 200;
+	unsigned int baud = 9600;
+	unsigned int simulators = 4;
+	bool json = false;
+	bool pace = false;
+	bool printMetrics = false;
+	bool loopback = false;
+	std::vector<std::string> uarts;
+	HCSSimulator::Options options;
+
+	int opt;
+	while((opt = getopt(argc, argv, "n:d:s:b:l:pr:g:t:jm")) != -1)
+	{
+		switch(opt){
+		case 'n': iterations = std::atoi(optarg); break;
+		case 'd': uarts.push_back(optarg); break;
+		case 's': simulators = std::max(std::atoi(optarg), 1); break;
+		case 'b': baud = std::atoi(optarg); break;
+		case 'l': options.latency = std::chrono::microseconds(std::atoi(optarg)); break;
+		case 'p': pace = true; break;
+		case 'r': options.dropRate = std::atof(optarg); break;
+		case 'g': options.garbleRate = std::atof(optarg); break;
+		case 't': loopback = (std::string(optarg) == "loopback"); break;
+		case 'j': json = true; break;
+		case 'm': printMetrics = true; break;
+		default:
+			std::cerr << "usage: " << argv[0] << " [-n iterations] [-d device]... [-s simulators] [-b baud] [-l latency_us] [-p] [-r drop_rate] [-g garble_rate] [-t pty|loopback] [-j] [-m]\n";
+			return 1;
+		}
+	}
+
+	HCSManager m;
+	std::vector<Result> results;
+	std::vector<std::unique_ptr<HCSSimulator>> simulated;
+	if(uarts.empty())
+	{
+		options.baud = pace ? baud : 0;
+		options.terminal = !loopback;
+		for(unsigned int i = 0; i < simulators; ++i)
+		{
+			options.seed = i + 1;
+			simulated.emplace_back(new HCSSimulator(options));
+			if(loopback)
+			{
+				HCSSimulator *s = simulated.back().get();
+				m.add(std::unique_ptr<Transport>(new LoopbackTransport([s](const std::string& cmd){ return s->respond(cmd); })));
+				uarts.push_back("loopback" + std::to_string(i));
+			}else{
+				uarts.push_back(simulated.back()->device());
+			}
+		}
+	}
+
+	for(size_t i = m.size(); i < uarts.size(); ++i){
+		m.add(uarts[i], baud);
+	}
+	m.connect();
+	for(size_t i = 0; i < m.size(); ++i){
+		m[i].init();
+	}
+	HCS& h = m[0];
+	const size_t n = m.size();
+
+	// single commands on the first device
+	results.push_back(measure("single", "VOLT", 1, 1, iterations, [&](int i){ h.setVoltage(i % 2 ? 5.0f : 12.0f); }));
+	results.push_back(measure("single", "CURR", 1, 1, iterations, [&](int i){ h.setCurrent(i % 2 ? 1.0f : 2.0f); }));
+	results.push_back(measure("single", "VOLT elided", 1, 1, iterations, [&](int){ h.setVoltage(12.0f); }));
+	results.push_back(measure("single", "GETS", 1, 1, iterations, [&](int){ h.getPresentVoltageAndCurrent(false); }));
+	results.push_back(measure("single", "GETD", 1, 1, iterations, [&](int){ h.readStatus(); }));
+	results.push_back(measure("single", "GOVP", 1, 1, iterations, [&](int){ h.getPresentUpperLimitVoltage(); }));
+	results.push_back(measure("single", "GOCP", 1, 1, iterations, [&](int){ h.getPresentUpperLimitCurrent(); }));
+	results.push_back(measure("single", "SOVP", 1, 1, iterations, [&](int){ h.setUpperVoltageLimit(30.0f, true); }));
+	results.push_back(measure("single", "SOCP", 1, 1, iterations, [&](int){ h.setUpperCurrentLimit(4.0f, true); }));
+	results.push_back(measure("single", "GETM", 1, 1, iterations, [&](int){ h.readMemoryValues(); }));
+	results.push_back(measure("single", "RUNM", 1, 1, iterations, [&](int i){ h.runMemory(static_cast<HCS::MEMORY>(i % 3)); }));
+	results.push_back(measure("single", "PROM", 1, 1, iterations, [&](int){ h.setMemory(5.0f, 1.0f, 12.0f, 1.5f, 24.0f, 2.0f); }));
+	results.push_back(measure("single", "GMAX+GOVP+GOCP", 1, 3, iterations, [&](int){ h.invalidate(); h.init(); }));
+
+	// batches on the first device
+	HCS::Batch setAndRead(h);
+	setAndRead.setVoltage(5.0f, true);
+	setAndRead.setCurrent(1.0f, true);
+	setAndRead.getPresentVoltageAndCurrent();
+	setAndRead.readStatus();
+	results.push_back(measure("batch", "VOLT+CURR+GETS+GETD", 1, setAndRead.size(), iterations, [&](int){ setAndRead.execute(); }));
+
+	HCS::Batch reads(h);
+	for(int i = 0; i < 8; ++i){
+		reads.getPresentVoltageAndCurrent();
+	}
+	results.push_back(measure("batch", "8xGETS", 1, reads.size(), iterations, [&](int){ reads.execute(); }));
+
+	// all devices, blocking calls of the manager
+	const std::vector<float> voltages[2] = {std::vector<float>(n, 5.0f), std::vector<float>(n, 12.0f)};
+	results.push_back(measure("multi", "VOLT", n, n, iterations, [&](int i){ m.setVoltage(voltages[i % 2]); }));
+	results.push_back(measure("multi", "GETS", n, n, iterations, [&](int){ m.getPresentVoltageAndCurrent(); }));
+
+	// all devices, asynchronous commands on the I/O thread with 4 commands in flight per device
+	m.start();
+	results.push_back(measure("async", "GETS", n, n, iterations, [&](int){
+		std::vector<std::future<std::string>> f;
+		for(size_t d = 0; d < n; ++d){
+			f.push_back(m[d].getPresentVoltageAndCurrentAsync());
+		}
+		for(auto& r : f){
+			r.get();
+		}
+	}));
+	results.push_back(measure("async", "4xGETS", n, 4 * n, iterations, [&](int){
+		std::vector<std::future<std::string>> f;
+		for(int k = 0; k < 4; ++k){
+			for(size_t d = 0; d < n; ++d){
+				f.push_back(m[d].getPresentVoltageAndCurrentAsync());
+			}
+		}
+		for(auto& r : f){
+			r.get();
+		}
+	}));
+
+	// setpoints on the first device, while another thread keeps 32 reads waiting on it.
+	// The setpoints overtake the waiting reads, see HCSManager
+	std::atomic<bool> polling{true};
+	std::thread poller([&]{
+		std::deque<std::future<std::string>> f;
+		while(polling || !f.empty())
+		{
+			while(polling && f.size() < 32){
+				f.push_back(h.getPresentVoltageAndCurrentAsync());
+			}
+			try{
+				f.front().get();
+			}catch (std::exception&) {
+				// dropped replies are counted by the metrics
+			}
+			f.pop_front();
+		}
+	});
+	results.push_back(measure("polled", "VOLT", 1, 1, iterations, [&](int i){ h.setVoltage(i % 2 ? 5.0f : 12.0f); }));
+	polling = false;
+	poller.join();
+	m.stop();
+
+	m.disconnect();
+
+	std::vector<std::string> metrics;
+	for(size_t i = 0; printMetrics && i < n; ++i){
+		metrics.push_back(json ? "{\"device\":\"" + uarts[i] + "\",\"metrics\":" + m[i].metrics().toJson() + "}" : m[i].metrics().toText());
+	}
+
+	if(json){
+		printJson(results, baud, !simulated.empty(), metrics);
+	}else{
+		printTable(results);
+		for(size_t i = 0; i < metrics.size(); ++i){
+			std::cout << "\ndevice <" << uarts[i] << ">\n" << metrics[i];
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * export.cpp
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ *  Exports a binary telemetry file of TelemetryRecorder as CSV.
+ *
+ *  usage: manson-export <telemetry file> [csv file]
+ */
+
+#include "TelemetryRecorder.h"
+
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+
+int main(int argc, char **argv) {
+	if(argc < 2){
+		std::cerr << "usage: " << argv[0] << " <telemetry file> [csv file]\n";
+		return 1;
+	}
+
+	try{
+		TelemetryReader reader(argv[1]);
+
+		FILE *out = (argc > 2) ? std::fopen(argv[2], "w") : stdout;
+		if(out == nullptr){
+			throw std::runtime_error("could not create <" + std::string(argv[2]) + ">");
+		}
+
+		static const char *MODE[] = {"", "CV", "CC"};
+		static const char *SOURCE[] = {"GETS", "GETD"};
+
+		std::fprintf(out, "timestamp_ns,voltage,current,mode,source\n");
+		for(const TelemetryRecord& r : reader)
+		{
+			std::fprintf(out, "%lld,%.2f,%.2f,%s,%s\n", static_cast<long long>(r.timestamp), r.getVoltage(), r.getCurrent(),
+					(r.mode < 3) ? MODE[r.mode] : "", (r.source < 2) ? SOURCE[r.source] : "");
+		}
+
+		if(out != stdout){
+			std::fclose(out);
+		}
+	}catch (std::exception& e) {
+		std::cerr << e.what() << '\n';
+		return 1;
+	}
+	return 0;
+}
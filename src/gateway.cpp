@@ -0,0 +1,105 @@
+/*
+ * gateway.cpp
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ *  Shares the given devices with many clients, see HCSGateway.
+ *  Runs until SIGINT or SIGTERM.
+ *
+ *  usage: manson-gateway [options] [device]...
+ *	-u <path>			Unix socket (default /tmp/manson.sock)
+ *	-t <port>			TCP port, 0 disables TCP (default 0)
+ *	-a <address>		TCP address (default 127.0.0.1)
+ *	-b <baud>			baud rate of the devices (default 9600)
+ *	-q <depth>			commands in flight per device (default 1)
+ *	-s <count>			serve simulators, if no device is given (default 1)
+ *
+ *	$ echo "0 GETS" | socat - UNIX-CONNECT:/tmp/manson.sock
+ *	0 050010
+ */
+
+#include "HCSGateway.h"
+#include "HCSManager.h"
+#include "HCSSimulator.h"
+
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	HCSGateway::Options options;
+	options.unixPath = "/tmp/manson.sock";
+	unsigned int baud = 9600;
+	unsigned int simulators = 1;
+
+	int opt;
+	while((opt = getopt(argc, argv, "u:t:a:b:q:s:")) != -1)
+	{
+		switch(opt)
+		{
+		case 'u': options.unixPath = optarg; break;
+		case 't': options.tcpPort = static_cast<unsigned short>(std::atoi(optarg)); break;
+		case 'a': options.tcpAddress = optarg; break;
+		case 'b': baud = std::atoi(optarg); break;
+		case 'q': options.pipelineDepth = std::max(std::atoi(optarg), 1); break;
+		case 's': simulators = std::max(std::atoi(optarg), 1); break;
+		default:
+			std::cerr << "usage: " << argv[0] << " [-u socket] [-t port] [-a address] [-b baud] [-q depth] [-s simulators] [device]...\n";
+			return 1;
+		}
+	}
+
+	// the signals are received by sigwait() only, the threads started below inherit the mask
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+	try{
+		HCSManager m;
+		std::vector<std::unique_ptr<HCSSimulator>> simulated;
+		if(optind == argc)
+		{
+			for(unsigned int i = 0; i < simulators; ++i)
+			{
+				HCSSimulator::Options o;
+				o.seed = i + 1;
+				simulated.emplace_back(new HCSSimulator(o));
+				m.add(simulated.back()->device(), baud);
+			}
+		}
+		for(int i = optind; i < argc; ++i){
+			m.add(argv[i], baud);
+		}
+		m.connect();
+
+		HCSGateway gateway(m, options);
+		gateway.start();
+		std::cout << "serving " << m.size() << " device(s) on " << options.unixPath;
+		if(options.tcpPort != 0){
+			std::cout << " and " << options.tcpAddress << ":" << options.tcpPort;
+		}
+		std::cout << std::endl;
+
+		int sig;
+		sigwait(&signals, &sig);
+		gateway.stop();
+		m.stop();
+
+		HCSGateway::Statistics s = gateway.statistics();
+		std::cout << "requests " << s.requests << ", transactions " << s.transactions << ", coalesced " << s.coalesced << std::endl;
+	}catch (std::exception& e) {
+		std::cerr << e.what() << '\n';
+		return 1;
+	}
+	return 0;
+}
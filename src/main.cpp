@@ -7,6 +7,7 @@
  */
 
 #include "HCS.h"
+#include "HCSSweep.h"
 #include <iostream>
 
 const std::string SERIAL_DEVICE = "/dev/ttyUSB0";
@@ -17,6 +18,7 @@ constexpr unsigned int BAUDRATE = 9600;
 int main(int argc, char **argv) {
 
 
+	// the library logs warnings and errors only (see Log.h), the example prints the values it reads
 	std::cout << "starting Manson HCS test\n\n";
 	HCS h(SERIAL_DEVICE, static_cast<unsigned int>(BAUDRATE));
 	h.connect();
@@ -28,28 +30,23 @@ int main(int argc, char **argv) {
 
 
 	h.setVoltage(15.2f);
-	h.getPresentVoltageAndCurrent();
-	std::cout << "\n\n";
+	std::cout << h.getPresentVoltageAndCurrent() << "\n\n";
 	std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
 
 	h.setVoltage(12.2f);
-	h.getPresentVoltageAndCurrent();
-	std::cout << "\n\n";
+	std::cout << h.getPresentVoltageAndCurrent() << "\n\n";
 	std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
 
 	h.setVoltage(5.4f);
-	h.getPresentVoltageAndCurrent();
-	std::cout << "\n\n";
+	std::cout << h.getPresentVoltageAndCurrent() << "\n\n";
 	std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
 
 	h.setVoltage(7.3f);
-	h.getPresentVoltageAndCurrent();
-	std::cout << "\n\n";
+	std::cout << h.getPresentVoltageAndCurrent() << "\n\n";
 	std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
 
 	h.setVoltage(6.9f);
-	h.getPresentVoltageAndCurrent();
-	std::cout << "\n\n";
+	std::cout << h.getPresentVoltageAndCurrent() << "\n\n";
 
 	h.disconnect();
 
@@ -76,12 +73,17 @@ int main(int argc, char **argv) {
 	std::cout << j.getPresentVoltageAndCurrent() << "\n\n";
 	std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
 
-	int k = 0;
-	while((k+=2) <= 32){
-		j.setVoltage(k);
-		std::cout << j.getPresentVoltageAndCurrent() << "\n\n";
-		std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+	// the output is read back until it settled, instead of waiting delay_ms per point
+	HCSSweep::Options o;
+	o.from = 2.0f;
+	o.to = 32.0f;
+	o.step = 2.0f;
+	HCSSweep sweep(j, o);
+	sweep.run();
+	for(const HCSSweep::Point& p : sweep.result()){
+		std::cout << p.setpoint << " V: " << p.voltage << " V " << p.current << " A" << (p.settled ? "" : " (not settled)") << "\n";
 	}
+	sweep.writeCsv("iv.csv");
 
 	j.disconnect();
 }
@@ -0,0 +1,579 @@
+/*
+ * test.cpp
+ *
+ *	Copyright (C) 2020 Marco Scholtyssek <code@scholtyssek.org>
+ *  Created on: Oct 17, 2026
+ *
+ *  Tests of HCSManager with several HCSSimulator instances on pseudo terminals.
+ *  Each device is a PTY, the library talks to it as it would talk to /dev/ttyUSBx.
+ *  Checks parallel setpoints, the readback of every device and that an unplugged
+ *  or silent device does not affect the others. The decoders of the responses and
+ *  a single simulator in memory (LoopbackTransport) are checked first.
+ *
+ *  usage: manson-test [-s simulators]
+ *	-s <count>			number of simulators (default 4, at least 3)
+ *
+ *  The exit code is the number of failed checks, capped at 255.
+ */
+
+#include "HCS.h"
+#include "HCSManager.h"
+#include "HCSSimulator.h"
+#include "Protocol.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+static unsigned int failures = 0;
+
+#define CHECK(condition, message) \
+	do { \
+		if(!(condition)){ \
+			++failures; \
+			std::cerr << "FAILED " << __func__ << ":" << __LINE__ << ": " << message << "\n"; \
+		} \
+	} while(0)
+
+static bool near(const float a, const float b)
+{
+	return std::fabs(a - b) < 0.01f;
+}
+
+// simulators on pseudo terminals and a manager, that owns a device on each of them
+struct Rack {
+	static constexpr size_t NONE = static_cast<size_t>(-1);
+
+	std::vector<std::unique_ptr<HCSSimulator>> simulators;
+	HCSManager manager;
+
+	// the simulator of device silent drops every reply, the device is not initialized
+	// and its commands fail after two short tries
+	explicit Rack(const unsigned int count, const size_t silent = NONE)
+	{
+		for(unsigned int i = 0; i < count; ++i)
+		{
+			HCSSimulator::Options o;
+			o.seed = i + 1;
+			o.dropRate = (i == silent) ? 1.0 : 0.0;
+			simulators.emplace_back(new HCSSimulator(o));
+			manager.add(simulators.back()->device(), 9600);
+		}
+		manager.connect();
+		for(size_t i = 0; i < manager.size(); ++i)
+		{
+			if(i != silent){
+				manager[i].init();
+			}
+		}
+		if(silent != NONE)
+		{
+			HCSTimeoutPolicy::Options o;
+			o.tries = 2;
+			o.initialTimeout = std::chrono::milliseconds(50);
+			o.maxTimeout = std::chrono::milliseconds(100);
+			o.adaptive = false;
+			manager[silent].timeoutPolicy().setOptions(o);
+		}
+	}
+
+	// the device on the PTY is unplugged
+	void unplug(const size_t i)
+	{
+		simulators[i].reset();
+	}
+};
+
+// a simulator in memory, that is connected to its device with a LoopbackTransport.
+// commands holds every command written to the simulator, without "\r"
+struct Loopback {
+	HCSSimulator simulator;
+	std::vector<std::string> commands;
+	std::string drop;	// the next reply to this command is lost, the simulator takes the command
+	HCS hcs;
+
+	Loopback() : simulator(options()),
+			hcs(std::unique_ptr<Transport>(new LoopbackTransport([this](const std::string& cmd){ return respond(cmd); })))
+	{
+		hcs.connect();
+		hcs.init();
+	}
+
+	static HCSSimulator::Options options()
+	{
+		HCSSimulator::Options o;
+		o.terminal = false;
+		return o;
+	}
+
+	std::string respond(const std::string& cmd)
+	{
+		commands.push_back(cmd);
+		const std::string reply = simulator.respond(cmd);
+		if(cmd == drop)
+		{
+			drop.clear();
+			return "";
+		}
+		return reply;
+	}
+
+	// commands with the mnemonic, that were written after the first from commands
+	size_t count(const std::string& mnemonic, const size_t from) const
+	{
+		return std::count_if(commands.begin() + std::min(from, commands.size()), commands.end(),
+				[&mnemonic](const std::string& cmd){ return cmd.compare(0, mnemonic.size(), mnemonic) == 0; });
+	}
+};
+
+static std::vector<float> values(const size_t count, const float first, const float step)
+{
+	std::vector<float> v;
+	for(size_t i = 0; i < count; ++i){
+		v.push_back(first + step * i);
+	}
+	return v;
+}
+
+/**
+ * One setVoltage()/setCurrent() of the manager sets a different value on every device
+ */
+static void parallelSetpoints(const unsigned int count)
+{
+	Rack rack(count);
+	const std::vector<float> voltages = values(count, 1.0f, 1.5f);
+	const std::vector<float> currents = values(count, 0.5f, 0.2f);
+
+	rack.manager.setVoltage(voltages);
+	rack.manager.setCurrent(currents);
+	for(unsigned int i = 0; i < count; ++i)
+	{
+		const HCSSimulator::Preset p = rack.simulators[i]->getPreset();
+		CHECK(near(p.voltage, voltages[i]), "device " << i << " has " << p.voltage << " V instead of " << voltages[i] << " V");
+		CHECK(near(p.current, currents[i]), "device " << i << " has " << p.current << " A instead of " << currents[i] << " A");
+	}
+
+	// the same on the I/O thread, the commands of all devices are in flight at once
+	rack.manager.start();
+	const std::vector<float> next = values(count, 12.0f, 0.5f);
+	std::vector<std::future<void>> done;
+	for(unsigned int i = 0; i < count; ++i){
+		done.push_back(rack.manager[i].setVoltageAsync(next[i]));
+	}
+	for(unsigned int i = 0; i < count; ++i)
+	{
+		done[i].get();
+		CHECK(near(rack.simulators[i]->getPreset().voltage, next[i]), "device " << i << " did not take the asynchronous setpoint " << next[i] << " V");
+	}
+	rack.manager.stop();
+	rack.manager.disconnect();
+}
+
+/**
+ * Each device reports its own presets (GETS) and output (GETD), in the order the devices were added
+ */
+static void readback(const unsigned int count)
+{
+	Rack rack(count);
+	const std::vector<float> voltages = values(count, 2.0f, 1.0f);
+	const std::vector<float> currents = values(count, 1.0f, 0.1f);
+	rack.manager.setVoltage(voltages);
+	rack.manager.setCurrent(currents);
+
+	const std::vector<std::string> presets = rack.manager.getPresentVoltageAndCurrent();
+	CHECK(presets.size() == count, "expected " << count << " responses, got " << presets.size());
+	for(size_t i = 0; i < std::min<size_t>(presets.size(), count); ++i)
+	{
+		Protocol::Measurement m;
+		CHECK(Protocol::decodeSetpoint(presets[i], m), "device " << i << " sent the malformed presets <" << presets[i] << ">");
+		CHECK(near(m.voltage, voltages[i]) && near(m.current, currents[i]),
+				"device " << i << " reports " << m.voltage << " V " << m.current << " A instead of " << voltages[i] << " V " << currents[i] << " A");
+	}
+
+	// blocking calls of any thread are passed to the I/O thread
+	rack.manager.start();
+	for(unsigned int i = 0; i < count; ++i)
+	{
+		const Protocol::Measurement m = rack.manager[i].readDisplay();
+		CHECK(near(m.voltage, voltages[i]) && m.mode == Protocol::Mode::CV,
+				"device " << i << " displays " << m.voltage << " V instead of " << voltages[i] << " V in CV");
+	}
+	rack.manager.stop();
+	rack.manager.disconnect();
+}
+
+/**
+ * An unplugged device fails its own commands only, the other devices take theirs
+ */
+static void errorIsolation(const unsigned int count)
+{
+	Rack rack(count);
+	const size_t broken = 1;
+	rack.unplug(broken);
+
+	// a blocking call on all devices throws, after the others took their setpoints
+	const std::vector<float> voltages = values(count, 3.0f, 1.0f);
+	bool thrown = false;
+	try{
+		rack.manager.setVoltage(voltages);
+	}catch (std::exception&) {
+		thrown = true;
+	}
+	CHECK(thrown, "setVoltage() did not report the unplugged device");
+	for(unsigned int i = 0; i < count; ++i)
+	{
+		if(i != broken){
+			CHECK(near(rack.simulators[i]->getPreset().voltage, voltages[i]), "device " << i << " missed its setpoint next to the unplugged device");
+		}
+	}
+
+	// the next blocking call on the other devices is not affected
+	for(unsigned int i = 0; i < count; ++i)
+	{
+		if(i == broken){
+			continue;
+		}
+		Protocol::Measurement m;
+		const std::string response = rack.manager[i].getPresentVoltageAndCurrent(false);
+		CHECK(Protocol::decodeSetpoint(response, m) && near(m.voltage, voltages[i]), "device " << i << " reports <" << response << "> next to the unplugged device");
+	}
+	rack.manager.disconnect();
+}
+
+/**
+ * A device, that does not answer, times out on the I/O thread, while the commands
+ * of the other devices complete without waiting for it
+ */
+static void timeoutIsolation(const unsigned int count)
+{
+	const size_t silent = count - 1;
+	Rack rack(count, silent);
+	rack.manager.start();
+
+	for(int round = 0; round < 3; ++round)
+	{
+		std::vector<std::future<std::string>> presets;
+		for(unsigned int i = 0; i < count; ++i){
+			presets.push_back(rack.manager[i].getPresentVoltageAndCurrentAsync());
+		}
+		for(unsigned int i = 0; i < count; ++i)
+		{
+			if(i == silent){
+				continue;
+			}
+			std::string response;
+			try{
+				response = presets[i].get();
+			}catch (std::exception& e) {
+				CHECK(false, "device " << i << " failed in round " << round << ": " << e.what());
+			}
+			Protocol::Measurement m;
+			CHECK(Protocol::decodeSetpoint(response, m), "device " << i << " sent the malformed presets <" << response << "> in round " << round);
+		}
+		CHECK(presets[silent].wait_for(std::chrono::seconds(0)) != std::future_status::ready,
+				"the other devices waited for the timeout of the silent device in round " << round);
+
+		bool failed = false;
+		try{
+			presets[silent].get();
+		}catch (std::exception&) {
+			failed = true;
+		}
+		CHECK(failed, "the silent device answered in round " << round);
+	}
+	rack.manager.stop();
+	rack.manager.disconnect();
+}
+
+/**
+ * The decoders of the responses accept the fixed width digits of the device only,
+ * short, signed and blank-padded values are rejected
+ */
+static void decoders()
+{
+	struct Digits {
+		const char *s;
+		size_t pos;
+		size_t count;
+		bool ok;
+		int value;
+	};
+	const Digits digits[] = {
+			{"123", 0, 3, true, 123},
+			{"000", 0, 3, true, 0},
+			{"0123", 1, 3, true, 123},
+			{"1234", 0, 3, true, 123},
+			{"", 0, 1, false, 0},
+			{"12", 0, 3, false, 0},
+			{"0123", 2, 3, false, 0},
+			{"-12", 0, 3, false, 0},
+			{"+12", 0, 3, false, 0},
+			{"1-2", 0, 3, false, 0},
+			{" 12", 0, 3, false, 0},
+			{"12 ", 0, 3, false, 0},
+			{"1 2", 0, 3, false, 0},
+			{"12a", 0, 3, false, 0},
+	};
+	for(const Digits& d : digits)
+	{
+		int value = -1;
+		const bool ok = Protocol::decodeDigits(d.s, d.pos, d.count, value);
+		CHECK(ok == d.ok && (!ok || value == d.value),
+				"decodeDigits(<" << d.s << ">, " << d.pos << ", " << d.count << ") returned " << ok << " and " << value);
+	}
+
+	// GMAX, GETS
+	struct Values {
+		const char *s;
+		bool ok;
+		float voltage;
+		float current;
+	};
+	const Values values[] = {
+			{"123045", true, 12.3f, 4.5f},
+			{"000000", true, 0.0f, 0.0f},
+			{"999999", true, 99.9f, 99.9f},
+			{"12304", false, 0, 0},
+			{"", false, 0, 0},
+			{"-23045", false, 0, 0},
+			{"123-45", false, 0, 0},
+			{" 23045", false, 0, 0},
+			{"123 45", false, 0, 0},
+			{"12304 ", false, 0, 0},
+	};
+	for(const Values& v : values)
+	{
+		Protocol::Values decoded{-1.0f, -1.0f};
+		const bool ok = Protocol::decodeValues(v.s, decoded);
+		CHECK(ok == v.ok && (!ok || (near(decoded.voltage, v.voltage) && near(decoded.current, v.current))),
+				"decodeValues(<" << v.s << ">) returned " << ok << " and " << decoded.voltage << " V " << decoded.current << " A");
+	}
+
+	// GETD
+	struct Display {
+		const char *s;
+		bool ok;
+		float voltage;
+		float current;
+		Protocol::Mode mode;
+	};
+	const Display displays[] = {
+			{"050001201", true, 5.0f, 1.2f, Protocol::Mode::CC},
+			{"120000000", true, 12.0f, 0.0f, Protocol::Mode::CV},
+			{"999999990", true, 99.99f, 99.99f, Protocol::Mode::CV},
+			{"05000120", false, 0, 0, Protocol::Mode::UNKNOWN},
+			{"", false, 0, 0, Protocol::Mode::UNKNOWN},
+			{"-50001200", false, 0, 0, Protocol::Mode::UNKNOWN},
+			{"0500-1200", false, 0, 0, Protocol::Mode::UNKNOWN},
+			{" 50001200", false, 0, 0, Protocol::Mode::UNKNOWN},
+			{"0500 1200", false, 0, 0, Protocol::Mode::UNKNOWN},
+			{"05000120 ", false, 0, 0, Protocol::Mode::UNKNOWN},
+	};
+	for(const Display& d : displays)
+	{
+		Protocol::Measurement m{-1.0f, -1.0f, Protocol::Mode::UNKNOWN};
+		const bool ok = Protocol::decodeDisplay(d.s, m);
+		CHECK(ok == d.ok && (!ok || (near(m.voltage, d.voltage) && near(m.current, d.current) && m.mode == d.mode)),
+				"decodeDisplay(<" << d.s << ">) returned " << ok << " and " << m.voltage << " V " << m.current << " A");
+	}
+
+	// GOVP, GOCP
+	struct Limit {
+		const char *s;
+		bool ok;
+		float limit;
+	};
+	const Limit limits[] = {
+			{"320", true, 32.0f},
+			{"050", true, 5.0f},
+			{"000", true, 0.0f},
+			{"32", false, 0},
+			{"", false, 0},
+			{"-32", false, 0},
+			{"3-2", false, 0},
+			{" 32", false, 0},
+			{"32 ", false, 0},
+	};
+	for(const Limit& l : limits)
+	{
+		float limit = -1.0f;
+		const bool ok = Protocol::decodeLimit(l.s, limit);
+		CHECK(ok == l.ok && (!ok || near(limit, l.limit)), "decodeLimit(<" << l.s << ">) returned " << ok << " and " << limit);
+	}
+
+	// GETM, line breaks are shown as '|' in the messages
+	struct Presets {
+		const char *s;
+		bool ok;
+		Protocol::Values memory[3];
+	};
+	const Presets presets[] = {
+			{"050010\r120020\r300050", true, {{5.0f, 1.0f}, {12.0f, 2.0f}, {30.0f, 5.0f}}},
+			{"000000\r000000\r000000", true, {{0.0f, 0.0f}, {0.0f, 0.0f}, {0.0f, 0.0f}}},
+			{"050010120020300050", false, {}},
+			{"050010\r120020300050", false, {}},
+			{"050010120020\r300050", false, {}},
+			{"050010 120020 300050", false, {}},
+			{"050010\n120020\n300050", false, {}},
+			{"050010\r120020\r", false, {}},
+			{"050010\r120020\r30005", false, {}},
+			{"050010\r120020", false, {}},
+			{"", false, {}},
+			{"050010\r-20020\r300050", false, {}},
+			{"050010\r120 20\r300050", false, {}},
+			{" 50010\r120020\r300050", false, {}},
+	};
+	for(const Presets& p : presets)
+	{
+		Protocol::Presets decoded{};
+		const bool ok = Protocol::decodePresets(p.s, decoded);
+		bool equal = true;
+		for(size_t i = 0; i < 3; ++i){
+			equal = equal && near(decoded.memory[i].voltage, p.memory[i].voltage) && near(decoded.memory[i].current, p.memory[i].current);
+		}
+		std::string shown(p.s);
+		std::replace_if(shown.begin(), shown.end(), [](const char c){ return c == '\r' || c == '\n'; }, '|');
+		CHECK(ok == p.ok && (!ok || equal), "decodePresets(<" << shown << ">) returned " << ok);
+	}
+}
+
+/**
+ * A setpoint, that the device has already, is not written again (see HCS::elide()),
+ * unless it is forced or the device may have changed it
+ */
+static void writeElision()
+{
+	Loopback l;
+	l.hcs.setVoltage(5.0f);
+	l.hcs.setCurrent(1.0f);
+	l.hcs.setUpperVoltageLimit(20.0f);
+
+	size_t from = l.commands.size();
+	l.hcs.setVoltage(5.0f);
+	l.hcs.setCurrent(1.0f);
+	l.hcs.setUpperVoltageLimit(20.0f);
+	CHECK(l.commands.size() == from, "repeated setpoints wrote " << l.commands.size() - from << " commands");
+
+	// a new value is written
+	from = l.commands.size();
+	l.hcs.setVoltage(6.0f);
+	CHECK(l.count("VOLT", from) == 1, "a new voltage was not written");
+
+	// force writes the same value
+	from = l.commands.size();
+	l.hcs.setVoltage(6.0f, true);
+	l.hcs.setCurrent(1.0f, true);
+	CHECK(l.count("VOLT", from) == 1 && l.count("CURR", from) == 1, "forced setpoints were not written");
+
+	// RUNM loads voltage and current of a preset, the limit is kept
+	l.hcs.runMemory(HCS::M1);
+	from = l.commands.size();
+	l.hcs.setVoltage(6.0f);
+	l.hcs.setCurrent(1.0f);
+	l.hcs.setUpperVoltageLimit(20.0f);
+	CHECK(l.count("VOLT", from) == 1 && l.count("CURR", from) == 1, "voltage and current were not written after RUNM");
+	CHECK(l.count("SOVP", from) == 0, "the upper voltage limit was written again after RUNM");
+	const HCSSimulator::Preset p = l.simulator.getPreset();
+	CHECK(near(p.voltage, 6.0f) && near(p.current, 1.0f), "the device has " << p.voltage << " V " << p.current << " A after RUNM");
+
+	// the device may have been changed, while it was disconnected. init() reads the limits again
+	l.hcs.disconnect();
+	l.hcs.connect();
+	l.hcs.init();
+	from = l.commands.size();
+	l.hcs.setVoltage(6.0f);
+	l.hcs.setCurrent(1.0f);
+	l.hcs.setUpperVoltageLimit(20.0f);
+	CHECK(l.count("VOLT", from) == 1 && l.count("CURR", from) == 1, "voltage and current were not written after a reconnect");
+	CHECK(l.count("SOVP", from) == 0, "the upper voltage limit, that init() read, was written again");
+}
+
+/**
+ * A lost reply is not replaced by the reply of the next command with the same frame:
+ * GOVP and GOCP both answer three digits, GOCP is written after the reply of GOVP
+ * (see HCS::transmit()), so the resent GOVP gets its own reply
+ */
+static void droppedReply()
+{
+	Loopback l;
+	l.hcs.setUpperVoltageLimit(25.0f);
+	l.hcs.setUpperCurrentLimit(3.0f);
+
+	l.drop = "GOVP";
+	const size_t from = l.commands.size();
+	HCS::Batch b(l.hcs);
+	const size_t govp = b.getPresentUpperLimitVoltage();
+	const size_t gocp = b.getPresentUpperLimitCurrent();
+	b.execute();
+	CHECK(b.response(govp) == "250" && b.response(gocp) == "030",
+			"GOVP returned <" << b.response(govp) << "> and GOCP <" << b.response(gocp) << "> instead of <250> and <030>");
+	CHECK(l.count("GOVP", from) == 2 && l.count("GOCP", from) == 1,
+			"GOVP was written " << l.count("GOVP", from) << " times and GOCP " << l.count("GOCP", from) << " times instead of 2 and 1");
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int simulators = 4;
+	int opt;
+	while((opt = getopt(argc, argv, "s:")) != -1)
+	{
+		switch(opt){
+		case 's': simulators = std::max(std::atoi(optarg), 3); break;
+		default:
+			std::cerr << "usage: " << argv[0] << " [-s simulators]\n";
+			return 1;
+		}
+	}
+
+	// without a pseudo terminal
+	const std::vector<std::pair<std::string, std::function<void()>>> checks = {
+			{"decoders", decoders},
+			{"write elision", writeElision},
+			{"dropped reply", droppedReply},
+	};
+
+	for(const auto& c : checks)
+	{
+		const unsigned int before = failures;
+		try{
+			c.second();
+		}catch (std::exception& e) {
+			++failures;
+			std::cerr << "FAILED " << c.first << ": " << e.what() << "\n";
+		}
+		std::cout << ((failures == before) ? "ok      " : "FAILED  ") << c.first << "\n";
+	}
+
+	const std::vector<std::pair<std::string, std::function<void(unsigned int)>>> tests = {
+			{"parallel setpoints", parallelSetpoints},
+			{"readback", readback},
+			{"error isolation", errorIsolation},
+			{"timeout isolation", timeoutIsolation},
+	};
+
+	for(const auto& t : tests)
+	{
+		const unsigned int before = failures;
+		try{
+			t.second(simulators);
+		}catch (std::exception& e) {
+			++failures;
+			std::cerr << "FAILED " << t.first << ": " << e.what() << "\n";
+		}
+		std::cout << ((failures == before) ? "ok      " : "FAILED  ") << t.first << " (" << simulators << " devices)\n";
+	}
+
+	std::cout << failures << " failed checks\n";
+	return std::min(failures, 255u);
+}